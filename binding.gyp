@@ -1,4 +1,8 @@
 {
+	"variables": {
+		# build the benchmarks with `node-gyp configure -- -Dbench=1`
+		"bench%": 0,
+	},
 	"targets": [
 		{
 			"target_name": "native_libnice",
@@ -6,10 +10,11 @@
 				"native/module.cpp",
 				"native/agent.cpp",
 				"native/stream.cpp",
-				"native/helper.cpp",
-			],
-			"defines": [
-				#'DO_DEBUG'
+				"native/pacer.cpp",
+				"native/capture.cpp",
+				"native/pair_cache.cpp",
+				"native/work_queue.cpp",
+				"native/trace.cpp",
 			],
 			'cflags': [
 				'-std=c++0x',
@@ -39,4 +44,56 @@
 
 		}
 	],
+	"conditions": [
+		[ 'bench==1', {
+			"targets": [
+				{
+					"target_name": "bench",
+					"type": "executable",
+					"sources": [
+						"native/bench.cpp",
+						"native/work_queue.cpp",
+						"native/trace.cpp",
+					],
+					'cflags': [
+						'-std=c++0x',
+						'<!@(pkg-config --cflags nice glib-2.0 libuv)',
+						'-Wall',
+						'-O2',
+						'-g',
+					],
+					'ldflags': [
+						'-pthread',
+					],
+					'libraries': [
+						'<!@(pkg-config --libs nice glib-2.0 libuv)',
+					],
+				},
+				{
+					"target_name": "bench_tsan",
+					"type": "executable",
+					"sources": [
+						"native/bench.cpp",
+						"native/work_queue.cpp",
+						"native/trace.cpp",
+					],
+					'cflags': [
+						'-std=c++0x',
+						'<!@(pkg-config --cflags nice glib-2.0 libuv)',
+						'-Wall',
+						'-O1',
+						'-g',
+						'-fsanitize=thread',
+					],
+					'ldflags': [
+						'-pthread',
+						'-fsanitize=thread',
+					],
+					'libraries': [
+						'<!@(pkg-config --libs nice glib-2.0 libuv)',
+					],
+				},
+			],
+		}],
+	],
 }
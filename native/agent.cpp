@@ -1,5 +1,6 @@
 #include "agent.h"
 
+#include <node_buffer.h>
 #include <string.h>
 #include <memory>
 #include <vector>
@@ -47,11 +48,55 @@ static NiceCompatibility getCompatibility(const std::string& id) {
 	if(it != compats.end()) {
 		return it->second;
 	} else {
-		DEBUG("unknown compatibility '" << id << "' requested");
+		TRACE(TRACE_AGENT, TRACE_ERROR, "unknown compatibility '" << id << "' requested");
 		return NICE_COMPATIBILITY_RFC5245;
 	}
 }
 
+static NiceRelayType getRelayTypeById(const std::string& id, bool& found) {
+	static std::map<std::string, NiceRelayType> types = {
+		{
+			"udp",
+			NICE_RELAY_TYPE_TURN_UDP,
+		},
+		{
+			"tcp",
+			NICE_RELAY_TYPE_TURN_TCP,
+		},
+		{
+			"tls",
+			NICE_RELAY_TYPE_TURN_TLS,
+		},
+	};
+
+	std::string lowerId = id;
+	std::transform(lowerId.begin(), lowerId.end(), lowerId.begin(), tolower);
+
+	auto it = types.find(lowerId);
+
+	found = it != types.end();
+
+	return found ? it->second : NICE_RELAY_TYPE_TURN_UDP;
+}
+
+bool Agent::getRelayType(v8::Handle<v8::Value> value, NiceRelayType& type) {
+	if(value->IsUndefined()) {
+		type = NICE_RELAY_TYPE_TURN_UDP;
+		return true;
+	}
+
+	v8::String::Utf8Value id(value->ToString());
+
+	bool found;
+	type = getRelayTypeById(*id, found);
+
+	if(!found) {
+		TRACE(TRACE_AGENT, TRACE_ERROR, "unknown relay type '" << *id << "' requested");
+	}
+
+	return found;
+}
+
 // lifecycle stuff
 
 void Agent::init(v8::Handle<v8::Object> exports) {
@@ -61,17 +106,24 @@ void Agent::init(v8::Handle<v8::Object> exports) {
 	tpl->InstanceTemplate()->SetInternalFieldCount(1);
 	// protoype
 	NODE_SET_PROTOTYPE_METHOD(tpl, "createStream", createStream);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "createStreams", createStreams);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "setMultiplexReceive", setMultiplexReceive);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "setLowMemory", setLowMemory);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "getMemoryUsage", getMemoryUsage);
 	NODE_SET_PROTOTYPE_METHOD(tpl, "setStunServer", setStunServer);
 	NODE_SET_PROTOTYPE_METHOD(tpl, "setSoftware", setSoftware);
 	NODE_SET_PROTOTYPE_METHOD(tpl, "setControlling", setControlling);
 	NODE_SET_PROTOTYPE_METHOD(tpl, "resetart", restart);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "addRelayServer", addRelayServer);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "enablePairCache", enablePairCache);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "getPairCacheStats", getPairCacheStats);
 	constructor = Persistent<Function>::New(tpl->GetFunction());
 	// export
 	exports->Set(String::NewSymbol("NiceAgent"), constructor);
 }
 
-Agent::Agent(NiceCompatibility compat) {
-	DEBUG("agent created");
+Agent::Agent(NiceCompatibility compat) : _multiplex_receive(false), _low_memory(false), _capturing(false) {
+	TRACE(TRACE_AGENT, TRACE_INFO, "agent created");
 
 	//nice_debug_enable(true);
 
@@ -90,6 +142,8 @@ Agent::Agent(NiceCompatibility compat) {
 	// register callbacks
 
 	g_signal_connect(G_OBJECT(_agent), "candidate-gathering-done", G_CALLBACK(gatheringDone), this);
+	g_signal_connect(G_OBJECT(_agent), "new-candidate", G_CALLBACK(newCandidate), this);
+	g_signal_connect(G_OBJECT(_agent), "new-selected-pair", G_CALLBACK(newSelectedPair), this);
 	g_signal_connect(G_OBJECT(_agent), "component-state-changed", G_CALLBACK(stateChanged), this);
 
 	// this creates a new thread, secure your v8 calls!
@@ -105,7 +159,7 @@ Agent::Agent(NiceCompatibility compat) {
 }
 
 Agent::~Agent() {
-	DEBUG("agent is dying");
+	TRACE(TRACE_AGENT, TRACE_INFO, "agent is dying");
 
 	g_main_loop_quit(_loop);
 	_thread.join();
@@ -117,16 +171,88 @@ Agent::~Agent() {
 }
 
 bool Agent::removeStream(int stream_id) {
+	setCapture(stream_id, std::shared_ptr<Capture>());
 	nice_agent_remove_stream(_agent, stream_id);
 	return _streams.erase(stream_id) > 0;
 }
 
+void Agent::setCapture(int stream_id, const std::shared_ptr<Capture>& capture) {
+	std::lock_guard<std::mutex> guard(_capture_mutex);
+
+	if(capture) {
+		_captures[stream_id] = capture;
+	} else {
+		_captures.erase(stream_id);
+	}
+
+	_capturing = !_captures.empty();
+}
+
+v8::Handle<v8::Object> Agent::addStream(v8::Handle<v8::Object> js_agent, int components) {
+	HandleScope scope;
+
+	// create nice stream
+
+	int stream_id = nice_agent_add_stream(_agent, components);
+
+	// create stream object
+
+	const int argc = 3;
+	Local<Value> argv[argc] = {
+		js_agent,
+		Integer::New(stream_id),
+		Integer::New(components)
+	};
+	Local<Object> stream = Stream::constructor->NewInstance(argc, argv);
+
+	// register receive callback, the stream does it when gathering in low memory mode
+
+	if(!_low_memory) {
+		attachReceive(stream_id, components);
+	}
+
+	// apply default relay servers
+
+	for(auto it = _relays.begin(); it != _relays.end(); ++it) {
+		for(int i = 1; i <= components; ++i) {
+			nice_agent_set_relay_info(_agent, stream_id, i, it->server.c_str(), it->port, it->username.c_str(), it->password.c_str(), it->type);
+		}
+	}
+
+	// save stream for callback handling
+
+	Stream *obj = node::ObjectWrap::Unwrap<Stream>(stream);
+	_streams[stream_id] = obj;
+
+	return scope.Close(stream);
+}
+
+void Agent::attachReceive(int stream_id, int components) {
+	auto context = g_main_loop_get_context(_loop);
+
+	for(int i = 1; i <= components; ++i) {
+		nice_agent_attach_recv(_agent, stream_id, i, context, receive, this);
+	}
+}
+
+void Agent::emitReceive(int stream_id, int component, const char* buf, size_t size) {
+	HandleScope scope;
+
+	const int argc = 4;
+	Handle<Value> argv[argc] = {
+		String::New("receive"),
+		Integer::New(stream_id),
+		Integer::New(component),
+		node::Buffer::New(buf, size)->handle_,
+	};
+
+	node::MakeCallback(handle_, "emit", argc, argv);
+}
+
 // do js work in right thread
 
 void Agent::addWork(const work_fun& fun) {
-	std::lock_guard<std::mutex> guard(_work_mutex);
-
-	_work_queue.push_back(fun);
+	_work.push(fun);
 
 	uv_async_send(_async);
 }
@@ -134,14 +260,9 @@ void Agent::addWork(const work_fun& fun) {
 void Agent::doWork(uv_async_t *async, int status) {
 	Agent *agent = (Agent*) async->data;
 
-	std::lock_guard<std::mutex> guard(agent->_work_mutex);
-
-	//DEBUG("doing work");
+	size_t jobs = agent->_work.run();
 
-	while(agent->_work_queue.size()) {
-		agent->_work_queue.front()();
-		agent->_work_queue.pop_front();
-	}
+	TRACE(TRACE_AGENT, TRACE_DEBUG, "did " << jobs << " jobs");
 }
 
 // js functions
@@ -173,41 +294,92 @@ v8::Handle<v8::Value> Agent::New(const v8::Arguments& args) {
 v8::Handle<v8::Value> Agent::createStream(const v8::Arguments& args) {
 	HandleScope scope;
 
-	// get native handles ...
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(args.This()->ToObject());
+
+	int components = args[0]->IsUndefined() ? 1 : args[0]->IntegerValue();
+
+	if(components < 1 || components > Stream::max_components) {
+		return ThrowException(Exception::RangeError(String::New("Invalid component count")));
+	}
+
+	Handle<Object> stream = agent->addStream(args.This(), components);
+
+	return scope.Close(stream);
+}
+
+v8::Handle<v8::Value> Agent::createStreams(const v8::Arguments& args) {
+	HandleScope scope;
 
 	Agent *agent = node::ObjectWrap::Unwrap<Agent>(args.This()->ToObject());
-	NiceAgent *nice_agent = agent->agent();
 
-	// create nice stream
+	int count = args[0]->IntegerValue();
+	int components = args[1]->IsUndefined() ? 1 : args[1]->IntegerValue();
 
-	int components = args[0]->IsUndefined() ? 1 : args[0]->IntegerValue();
+	if(count < 0) {
+		return ThrowException(Exception::RangeError(String::New("Invalid stream count")));
+	}
 
-	int stream_id = nice_agent_add_stream(nice_agent, components);
+	if(components < 1 || components > Stream::max_components) {
+		return ThrowException(Exception::RangeError(String::New("Invalid component count")));
+	}
 
-	// create stream object
+	Local<Array> res = Array::New(count);
 
-	const int argc = 3;
-	Local<Value> argv[argc] = {
-		args.This(),
-		Integer::New(stream_id),
-		Integer::New(components)
-	};
-	Local<Object> stream = Stream::constructor->NewInstance(argc, argv);
+	for(int i = 0; i < count; ++i) {
+		res->Set(i, agent->addStream(args.This(), components));
+	}
+
+	return scope.Close(res);
+}
 
-	// register receive callback
+v8::Handle<v8::Value> Agent::setMultiplexReceive(const v8::Arguments& args) {
+	HandleScope scope;
 
-	auto context = g_main_loop_get_context(agent->_loop);
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(args.This()->ToObject());
 
-	for(int i = 1; i <= components; ++i) {
-		nice_agent_attach_recv(nice_agent, stream_id, i, context, receive, agent);
+	agent->_multiplex_receive = args[0]->IsUndefined() || args[0]->BooleanValue();
+
+	return scope.Close(Undefined());
+}
+
+v8::Handle<v8::Value> Agent::setLowMemory(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(args.This()->ToObject());
+
+	agent->_low_memory = args[0]->IsUndefined() || args[0]->BooleanValue();
+
+	return scope.Close(Undefined());
+}
+
+v8::Handle<v8::Value> Agent::getMemoryUsage(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(args.This()->ToObject());
+
+	size_t streams = 0;
+	size_t components = 0;
+	size_t attached = 0;
+
+	for(auto it = agent->_streams.begin(); it != agent->_streams.end(); ++it) {
+		streams += it->second->memoryUsage();
+		components += it->second->components();
+		attached += it->second->attachedComponents();
 	}
 
-	// save stream for callback handling
+	// rough estimate of the map nodes
+	size_t own = sizeof(*agent) + agent->_streams.size() * (sizeof(stream_map::value_type) + 4 * sizeof(void*));
+	size_t cache = agent->_pair_cache.size() * (sizeof(CachedPair) + 64 + 4 * sizeof(void*));
 
-	Stream *obj = node::ObjectWrap::Unwrap<Stream>(stream);
-	agent->_streams[stream_id] = obj;
+	Local<Object> res = Object::New();
+	res->Set(String::New("streams"), Number::New(agent->_streams.size()));
+	res->Set(String::New("streamBytes"), Number::New(streams));
+	res->Set(String::New("pairCacheBytes"), Number::New(cache));
+	res->Set(String::New("attachedComponents"), Number::New(attached));
+	res->Set(String::New("unattachedComponents"), Number::New(components - attached));
+	res->Set(String::New("bytes"), Number::New(own + streams + cache));
 
-	return scope.Close(stream);
+	return scope.Close(res);
 }
 
 v8::Handle<v8::Value> Agent::setStunServer(const v8::Arguments& args) {
@@ -246,6 +418,61 @@ v8::Handle<v8::Value> Agent::restart(const v8::Arguments& args) {
 	return scope.Close(Boolean::New(res));
 }
 
+v8::Handle<v8::Value> Agent::addRelayServer(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(args.This()->ToObject());
+
+	RelayInfo relay;
+
+	if(!getRelayType(args[4], relay.type)) {
+		return ThrowException(Exception::TypeError(String::New("Unknown relay type")));
+	}
+
+	v8::String::Utf8Value server(args[0]->ToString());
+	v8::String::Utf8Value username(args[2]->ToString());
+	v8::String::Utf8Value password(args[3]->ToString());
+
+	relay.server = *server;
+	relay.port = args[1]->IntegerValue();
+	relay.username = *username;
+	relay.password = *password;
+
+	TRACE(TRACE_AGENT, TRACE_DEBUG, "adding relay server " << relay.server << ":" << relay.port);
+
+	agent->_relays.push_back(relay);
+
+	return scope.Close(Undefined());
+}
+
+v8::Handle<v8::Value> Agent::enablePairCache(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(args.This()->ToObject());
+
+	int max_age = args[0]->IsUndefined() ? 3600 * 1000 : args[0]->IntegerValue();
+	int max_entries = args[1]->IsUndefined() ? 10000 : args[1]->IntegerValue();
+
+	agent->_pair_cache.configure(max_age, max_entries);
+
+	return scope.Close(Undefined());
+}
+
+v8::Handle<v8::Value> Agent::getPairCacheStats(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(args.This()->ToObject());
+	PairCache& cache = agent->_pair_cache;
+
+	Local<Object> res = Object::New();
+	res->Set(String::New("hits"), Number::New(cache.hits()));
+	res->Set(String::New("misses"), Number::New(cache.misses()));
+	res->Set(String::New("stale"), Number::New(cache.stale()));
+	res->Set(String::New("entries"), Number::New(cache.size()));
+
+	return scope.Close(res);
+}
+
 v8::Handle<v8::Value> Agent::setSoftware(const v8::Arguments& args) {
 	HandleScope scope;
 
@@ -278,15 +505,47 @@ v8::Handle<v8::Value> Agent::setControlling(const v8::Arguments& args) {
 void Agent::gatheringDone(NiceAgent *nice_agent, guint stream_id, gpointer user_data) {
 	Agent *agent = reinterpret_cast<Agent*>(user_data);
 
-	DEBUG("gathering done on stream " << stream_id);
+	TRACE(TRACE_STATE, TRACE_INFO, "gathering done on stream " << stream_id);
+
+	gint64 time = g_get_monotonic_time();
 
 	agent->addWork([=]() {
 		auto it = agent->_streams.find(stream_id);
 
 		if(it != agent->_streams.end()) {
-			it->second->gatheringDone();
+			it->second->gatheringDone(time);
 		} else {
-			DEBUG("gathering done on unknown stream");
+			TRACE(TRACE_STATE, TRACE_ERROR, "gathering done on unknown stream");
+		}
+	});
+}
+
+void Agent::newCandidate(NiceAgent *nice_agent, guint stream_id, guint component_id, gchar *foundation, gpointer user_data) {
+	Agent *agent = reinterpret_cast<Agent*>(user_data);
+
+	TRACE(TRACE_STATE, TRACE_DEBUG, "new candidate on component " << component_id << " of stream " << stream_id);
+
+	gint64 time = g_get_monotonic_time();
+
+	agent->addWork([=]() {
+		auto it = agent->_streams.find(stream_id);
+
+		if(it != agent->_streams.end()) {
+			it->second->candidateGathered(component_id, time);
+		}
+	});
+}
+
+void Agent::newSelectedPair(NiceAgent *nice_agent, guint stream_id, guint component_id, gchar *lfoundation, gchar *rfoundation, gpointer user_data) {
+	Agent *agent = reinterpret_cast<Agent*>(user_data);
+
+	TRACE(TRACE_STATE, TRACE_DEBUG, "new selected pair on component " << component_id << " of stream " << stream_id);
+
+	agent->addWork([=]() {
+		auto it = agent->_streams.find(stream_id);
+
+		if(it != agent->_streams.end()) {
+			it->second->selectedPairChanged(component_id);
 		}
 	});
 }
@@ -294,15 +553,17 @@ void Agent::gatheringDone(NiceAgent *nice_agent, guint stream_id, gpointer user_
 void Agent::stateChanged(NiceAgent *nice_agent, guint stream_id, guint component_id, guint state, gpointer user_data) {
 	Agent *agent = reinterpret_cast<Agent*>(user_data);
 
-	DEBUG("state changed to " << state << " on component " << component_id << " of stream " << stream_id);
+	TRACE(TRACE_STATE, TRACE_INFO, "state changed to " << state << " on component " << component_id << " of stream " << stream_id);
+
+	gint64 time = g_get_monotonic_time();
 
 	agent->addWork([=]() {
 		auto it = agent->_streams.find(stream_id);
 
 		if(it != agent->_streams.end()) {
-			it->second->stateChanged(component_id, state);
+			it->second->stateChanged(component_id, state, time);
 		} else {
-			DEBUG("state changed on unknown stream");
+			TRACE(TRACE_STATE, TRACE_ERROR, "state changed on unknown stream");
 		}
 	});
 }
@@ -310,19 +571,30 @@ void Agent::stateChanged(NiceAgent *nice_agent, guint stream_id, guint component
 void Agent::receive(NiceAgent* nice_agent, guint stream_id, guint component_id, guint len, gchar* buf, gpointer user_data) {
 	Agent *agent = reinterpret_cast<Agent*>(user_data);
 
-	//DEBUG("receiving " << len << " bytes on component " << component_id << " of stream " << stream_id);
+	TRACE(TRACE_RECV, TRACE_DEBUG, "receiving " << len << " bytes on component " << component_id << " of stream " << stream_id);
+
+	if(agent->_capturing) {
+		std::lock_guard<std::mutex> guard(agent->_capture_mutex);
+
+		auto it = agent->_captures.find(stream_id);
+
+		if(it != agent->_captures.end()) {
+			it->second->write(CAPTURE_INBOUND, component_id, buf, len);
+		}
+	}
 
 	// TODO: this might not be the best solution ...
-	auto tmp_buf = std::make_shared<std::vector<char>>(len);
-	memcpy(tmp_buf->data(), buf, len);
+	auto tmp_buf = copy_buffer(buf, len);
+
+	gint64 time = g_get_monotonic_time();
 
 	agent->addWork([=]() {
 		auto it = agent->_streams.find(stream_id);
 
 		if(it != agent->_streams.end()) {
-			it->second->receive(component_id, tmp_buf->data(), len);
+			it->second->receive(component_id, tmp_buf->data(), len, time);
 		} else {
-			DEBUG("receiving on unknown stream");
+			TRACE(TRACE_RECV, TRACE_ERROR, "receiving on unknown stream");
 		}
 	});
 }
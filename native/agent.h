@@ -2,9 +2,12 @@
 #define AGENT_H 
 
 #include <map>
-#include <deque>
+#include <vector>
+#include <string>
 #include <mutex>
 #include <thread>
+#include <memory>
+#include <atomic>
 
 #include <glib.h>
 #include <nice/nice.h>
@@ -12,11 +15,23 @@
 #include <uv.h>
 
 #include "stream.h"
+#include "capture.h"
+#include "pair_cache.h"
+#include "work_queue.h"
 
 typedef std::map<int,Stream*> stream_map;
 
-typedef std::function<void(void)> work_fun;
-typedef std::deque<work_fun> work_queue;
+struct RelayInfo {
+	std::string server;
+	int port;
+	std::string username;
+	std::string password;
+	NiceRelayType type;
+};
+
+typedef std::vector<RelayInfo> relay_list;
+
+typedef std::map<int,std::shared_ptr<Capture>> capture_map;
 
 class Agent : public node::ObjectWrap {
 	public:
@@ -26,27 +41,53 @@ class Agent : public node::ObjectWrap {
 		static void init(v8::Handle<v8::Object> exports);
 
 		NiceAgent* agent() { return _agent; }
+		GMainContext* context() { return g_main_loop_get_context(_loop); }
 
 		bool removeStream(int stream_id);
 
+		PairCache& pairCache() { return _pair_cache; }
+
+		bool multiplexReceive() { return _multiplex_receive; }
+		bool lowMemory() { return _low_memory; }
+
+		void attachReceive(int stream_id, int components);
+		void emitReceive(int stream_id, int component, const char* buf, size_t size);
+
+		void setCapture(int stream_id, const std::shared_ptr<Capture>& capture);
+
+		static bool getRelayType(v8::Handle<v8::Value> value, NiceRelayType& type);
+
 	private:
 		// js functions
 
 		static v8::Handle<v8::Value> New(const v8::Arguments& args);
 		static v8::Handle<v8::Value> createStream(const v8::Arguments& args);
+		static v8::Handle<v8::Value> createStreams(const v8::Arguments& args);
+		static v8::Handle<v8::Value> setMultiplexReceive(const v8::Arguments& args);
+		static v8::Handle<v8::Value> setLowMemory(const v8::Arguments& args);
+		static v8::Handle<v8::Value> getMemoryUsage(const v8::Arguments& args);
 		static v8::Handle<v8::Value> setStunServer(const v8::Arguments& args);
 		static v8::Handle<v8::Value> setSoftware(const v8::Arguments& args);
 		static v8::Handle<v8::Value> setControlling(const v8::Arguments& args);
 		static v8::Handle<v8::Value> restart(const v8::Arguments& args);
+		static v8::Handle<v8::Value> addRelayServer(const v8::Arguments& args);
+		static v8::Handle<v8::Value> enablePairCache(const v8::Arguments& args);
+		static v8::Handle<v8::Value> getPairCacheStats(const v8::Arguments& args);
 
 		static v8::Persistent<v8::Function> constructor;
 
 		// callbacks
 
 		static void gatheringDone(NiceAgent *agent, guint stream_id, gpointer user_data);
+		static void newSelectedPair(NiceAgent *agent, guint stream_id, guint component_id, gchar *lfoundation, gchar *rfoundation, gpointer user_data);
+		static void newCandidate(NiceAgent *agent, guint stream_id, guint component_id, gchar *foundation, gpointer user_data);
 		static void stateChanged(NiceAgent *agent, guint stream_id, guint component_id, guint state, gpointer user_data);
 		static void receive(NiceAgent* agent, guint stream_id, guint component_id, guint len, gchar* buf, gpointer user_data);
 
+		// helper
+
+		v8::Handle<v8::Object> addStream(v8::Handle<v8::Object> js_agent, int components);
+
 		// worker callback
 
 		static void doWork(uv_async_t *async, int status);
@@ -60,6 +101,28 @@ class Agent : public node::ObjectWrap {
 
 		stream_map _streams;
 
+		// emit receive on the agent instead of the streams
+
+		bool _multiplex_receive;
+
+		// attach lazily and release setup state of streams
+
+		bool _low_memory;
+
+		// relay servers applied to new streams
+
+		relay_list _relays;
+
+		// selected pairs of previous connections
+
+		PairCache _pair_cache;
+
+		// packet captures, accessed from the glib thread
+
+		std::mutex _capture_mutex;
+		capture_map _captures;
+		std::atomic<bool> _capturing;
+
 		// own main loop
 
 		std::thread _thread;
@@ -67,8 +130,7 @@ class Agent : public node::ObjectWrap {
 
 		// passing work around
 
-		std::mutex _work_mutex;
-		work_queue _work_queue;
+		WorkQueue _work;
 		uv_async_t *_async;
 };
 
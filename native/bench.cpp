@@ -0,0 +1,286 @@
+// micro benchmarks and stress test of the native internals, no sockets involved
+//
+// build with `node-gyp configure build -- -Dbench=1`, then run
+//
+//   build/Release/bench [filter]     ns/op and allocations/op
+//   build/Release/bench_tsan --stress   glib producers against an uv consumer
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <glib.h>
+#include <nice/nice.h>
+#include <uv.h>
+
+#include "helper.h"
+#include "work_queue.h"
+
+// count allocations
+
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	void *res = malloc(size ? size : 1);
+
+	if(res == NULL) {
+		throw std::bad_alloc();
+	}
+
+	return res;
+}
+
+void operator delete(void* ptr) noexcept {
+	free(ptr);
+}
+
+// runner
+
+typedef std::function<void(size_t)> bench_fun;
+
+static const char* filter = NULL;
+
+static void bench(const std::string& name, size_t iterations, const bench_fun& fun) {
+	if(filter != NULL && name.find(filter) == std::string::npos) {
+		return;
+	}
+
+	// warm up
+	fun(iterations / 10 + 1);
+
+	uint64_t allocs_before = allocations.load();
+	auto start = std::chrono::steady_clock::now();
+
+	fun(iterations);
+
+	auto duration = std::chrono::steady_clock::now() - start;
+	uint64_t allocs = allocations.load() - allocs_before;
+
+	double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+
+	printf("%-32s %12.1f ns/op %8.2f allocs/op\n", name.c_str(), ns / iterations, (double) allocs / iterations);
+}
+
+// benchmarks
+
+static void benchWorkQueue(int producers, size_t iterations) {
+	WorkQueue queue;
+	std::atomic<size_t> done(0);
+	std::vector<std::thread> threads;
+
+	const size_t per_producer = iterations / producers;
+	const size_t total = per_producer * producers;
+
+	for(int i = 0; i < producers; ++i) {
+		threads.push_back(std::thread([&]() {
+			for(size_t j = 0; j < per_producer; ++j) {
+				queue.push([&]() {
+					done.fetch_add(1, std::memory_order_relaxed);
+				});
+			}
+		}));
+	}
+
+	while(done.load(std::memory_order_relaxed) < total) {
+		if(queue.run() == 0) {
+			std::this_thread::yield();
+		}
+	}
+
+	for(auto it = threads.begin(); it != threads.end(); ++it) {
+		it->join();
+	}
+}
+
+static void benchReceiveCopy(size_t len, size_t iterations) {
+	// what Agent::receive does for every packet
+	std::vector<char> packet(len, 'x');
+	WorkQueue queue;
+	size_t received = 0;
+
+	for(size_t i = 0; i < iterations; ++i) {
+		auto buf = copy_buffer(packet.data(), len);
+
+		queue.push([=, &received]() {
+			received += buf->size();
+		});
+
+		queue.run();
+	}
+}
+
+static void benchCandidateParsing(size_t iterations) {
+	GMainContext *context = g_main_context_new();
+	NiceAgent *agent = nice_agent_new(context, NICE_COMPATIBILITY_RFC5245);
+	int stream_id = nice_agent_add_stream(agent, 1);
+
+	const char* line = "a=candidate:1 1 udp 2130706431 192.0.2.1 54321 typ host\r\n";
+
+	for(size_t i = 0; i < iterations; ++i) {
+		std::string sdp(line);
+		sanitize_candidate_sdp(sdp);
+
+		NiceCandidate *candidate = nice_agent_parse_remote_candidate_sdp(agent, stream_id, sdp.c_str());
+
+		if(candidate == NULL) {
+			fprintf(stderr, "unable to parse candidate\n");
+			exit(1);
+		}
+
+		nice_candidate_free(candidate);
+	}
+
+	g_object_unref(agent);
+	g_main_context_unref(context);
+}
+
+static void benchStateToString(size_t iterations) {
+	size_t len = 0;
+
+	for(size_t i = 0; i < iterations; ++i) {
+		len += strlen(state_to_string(i % (NICE_COMPONENT_STATE_LAST + 1)));
+	}
+
+	if(len == 0) {
+		abort();
+	}
+}
+
+// stress test, run under thread sanitizer
+
+struct Stress {
+	WorkQueue queue;
+	uv_async_t async;
+
+	size_t expected;
+	size_t received;
+	std::vector<size_t> last;
+	bool ordered;
+};
+
+#if UV_VERSION_MAJOR < 1
+static void stressConsume(uv_async_t *async, int status) {
+#else
+static void stressConsume(uv_async_t *async) {
+#endif
+	Stress *stress = reinterpret_cast<Stress*>(async->data);
+
+	stress->queue.run();
+}
+
+static int stress(int producers, size_t per_producer) {
+	Stress stress;
+	stress.expected = producers * per_producer;
+	stress.received = 0;
+	stress.last.assign(producers, 0);
+	stress.ordered = true;
+
+	uv_loop_t *loop = uv_default_loop();
+	uv_async_init(loop, &stress.async, stressConsume);
+	stress.async.data = &stress;
+
+	// every producer is a glib loop in its own thread, like the agents
+
+	std::vector<std::thread> threads;
+
+	for(int i = 0; i < producers; ++i) {
+		threads.push_back(std::thread([&stress, i, per_producer]() {
+			GMainContext *context = g_main_context_new();
+			GMainLoop *glib_loop = g_main_loop_new(context, FALSE);
+
+			size_t sent = 0;
+
+			auto produce = [&]() -> gboolean {
+				// a burst of receives per iteration of the loop
+				for(int j = 0; j < 64 && sent < per_producer; ++j) {
+					size_t seq = ++sent;
+					auto buf = copy_buffer((const char*) &seq, sizeof(seq));
+
+					stress.queue.push([&stress, i, seq, buf]() {
+						if(stress.last[i] + 1 != seq) {
+							stress.ordered = false;
+						}
+
+						stress.last[i] = seq;
+						++stress.received;
+					});
+
+					uv_async_send(&stress.async);
+				}
+
+				if(sent == per_producer) {
+					g_main_loop_quit(glib_loop);
+					return FALSE;
+				}
+
+				return TRUE;
+			};
+
+			typedef decltype(produce) produce_fun;
+
+			GSource *source = g_idle_source_new();
+			g_source_set_callback(source, [](gpointer data) -> gboolean {
+				return (*reinterpret_cast<produce_fun*>(data))();
+			}, &produce, NULL);
+			g_source_attach(source, context);
+			g_source_unref(source);
+
+			g_main_loop_run(glib_loop);
+
+			g_main_loop_unref(glib_loop);
+			g_main_context_unref(context);
+		}));
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	while(stress.received < stress.expected) {
+		uv_run(loop, UV_RUN_ONCE);
+	}
+
+	auto duration = std::chrono::steady_clock::now() - start;
+
+	// producers might still be signaling
+
+	for(auto it = threads.begin(); it != threads.end(); ++it) {
+		it->join();
+	}
+
+	uv_close((uv_handle_t*) &stress.async, NULL);
+	uv_run(loop, UV_RUN_DEFAULT);
+
+	double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+
+	printf("stress: %zu/%zu jobs from %d producers, %s, %.1f ns/job\n", stress.received, stress.expected, producers, stress.ordered ? "in order" : "OUT OF ORDER", ns / stress.expected);
+
+	return stress.received == stress.expected && stress.ordered ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+	if(argc > 1 && std::string(argv[1]) == "--stress") {
+		return stress(8, 200000);
+	}
+
+	if(argc > 1) {
+		filter = argv[1];
+	}
+
+	const size_t iterations = 1000000;
+
+	bench("work_queue/1_producer", iterations, [](size_t n) { benchWorkQueue(1, n); });
+	bench("work_queue/4_producers", iterations, [](size_t n) { benchWorkQueue(4, n); });
+	bench("work_queue/16_producers", iterations, [](size_t n) { benchWorkQueue(16, n); });
+	bench("receive_copy/100", iterations, [](size_t n) { benchReceiveCopy(100, n); });
+	bench("receive_copy/1200", iterations, [](size_t n) { benchReceiveCopy(1200, n); });
+	bench("candidate_parsing", iterations / 10, benchCandidateParsing);
+	bench("state_to_string", iterations * 10, benchStateToString);
+
+	return 0;
+}
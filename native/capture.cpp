@@ -0,0 +1,280 @@
+#include "capture.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <glib.h>
+
+#include <sstream>
+
+#include "helper.h"
+
+// pcapng block types and options
+
+#define PCAPNG_SECTION_HEADER	0x0A0D0D0A
+#define PCAPNG_INTERFACE	0x00000001
+#define PCAPNG_ENHANCED_PACKET	0x00000006
+// local use block, skipped by readers, covers space not holding packets
+#define PCAPNG_FILLER		0x80000001
+
+#define PCAPNG_BYTE_ORDER	0x1A2B3C4D
+#define PCAPNG_OPT_END		0
+#define PCAPNG_OPT_IF_NAME	2
+#define PCAPNG_OPT_EPB_FLAGS	2
+
+// payload is whatever the component transports, no link layer
+#define PCAPNG_LINKTYPE_USER0	147
+
+#define PCAPNG_MIN_BLOCK	12
+
+static inline size_t pad4(size_t len) {
+	return (len + 3) & ~((size_t) 3);
+}
+
+static inline void put16(char *dst, uint16_t value) {
+	memcpy(dst, &value, sizeof(value));
+}
+
+static inline void put32(char *dst, uint32_t value) {
+	memcpy(dst, &value, sizeof(value));
+}
+
+static inline void put64(char *dst, uint64_t value) {
+	memcpy(dst, &value, sizeof(value));
+}
+
+static inline size_t interfaceName(int component, std::string& name) {
+	std::ostringstream out;
+	out << "component " << component;
+	name = out.str();
+	return 16 + 4 + pad4(name.size()) + 4 + 4;
+}
+
+Capture::Capture(int components) : _components(components), _fd(-1), _map(NULL), _size(0), _start(0), _pos(0), _packets(0), _dropped(0) {
+}
+
+Capture::~Capture() {
+	close();
+}
+
+bool Capture::open(const std::string& path, size_t size) {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	size = size & ~((size_t) 3);
+
+	if(size < 28 + PCAPNG_MIN_BLOCK) {
+		TRACE(TRACE_STREAM, TRACE_ERROR, "capture size of " << size << " bytes is too small");
+		return false;
+	}
+
+	_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if(_fd < 0) {
+		TRACE(TRACE_STREAM, TRACE_ERROR, "unable to open capture file '" << path << "'");
+		return false;
+	}
+
+	// allocate all blocks now, a sparse file would allocate them while packets are written
+
+#ifdef __linux__
+	const bool resized = posix_fallocate(_fd, 0, size) == 0;
+#else
+	const bool resized = ftruncate(_fd, size) == 0;
+#endif
+
+	if(!resized) {
+		TRACE(TRACE_STREAM, TRACE_ERROR, "unable to resize capture file '" << path << "'");
+		::close(_fd);
+		_fd = -1;
+		return false;
+	}
+
+	int flags = MAP_SHARED;
+
+#ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;
+#endif
+
+	void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, _fd, 0);
+
+	if(map == MAP_FAILED) {
+		TRACE(TRACE_STREAM, TRACE_ERROR, "unable to map capture file '" << path << "'");
+		::close(_fd);
+		_fd = -1;
+		return false;
+	}
+
+	_map = reinterpret_cast<char*>(map);
+	_size = size;
+
+	// take the write faults here instead of in the packet path
+
+	const long page = sysconf(_SC_PAGESIZE);
+
+	for(size_t offset = 0; offset < _size; offset += page) {
+		_map[offset] = 0;
+	}
+
+	writeHeader();
+
+	if(_start + PCAPNG_MIN_BLOCK > _size) {
+		TRACE(TRACE_STREAM, TRACE_ERROR, "capture file '" << path << "' is too small");
+		munmap(_map, _size);
+		::close(_fd);
+		_map = NULL;
+		_fd = -1;
+		return false;
+	}
+
+	writeFiller(_start, _size - _start);
+	_pos = _start;
+
+	return true;
+}
+
+void Capture::close() {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	if(_map != NULL) {
+		msync(_map, _size, MS_SYNC);
+		munmap(_map, _size);
+		_map = NULL;
+	}
+
+	if(_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+}
+
+void Capture::write(CaptureDirection direction, int component, const char* buf, size_t len) {
+	// read before taking the lock
+	gint64 now = g_get_real_time();
+
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	if(_map == NULL) {
+		return;
+	}
+
+	// there is no interface for other components, the file would become invalid
+
+	if(component < 1 || component > _components) {
+		++_dropped;
+		return;
+	}
+
+	const size_t block = 28 + pad4(len) + 8 + 4 + 4;
+
+	// the rest of the file has to stay a valid chain of blocks, wrap if we would leave a gap too small for a filler
+
+	if(_pos + block != _size && _pos + block + PCAPNG_MIN_BLOCK > _size) {
+		_pos = _start;
+	}
+
+	if(_pos + block != _size && _pos + block + PCAPNG_MIN_BLOCK > _size) {
+		++_dropped;
+		return;
+	}
+
+	// find the end of the blocks we overwrite
+
+	const size_t end = _pos + block;
+	size_t next = _pos;
+
+	while(next < end || (next > end && next < end + PCAPNG_MIN_BLOCK)) {
+		next += blockLength(next);
+	}
+
+	// enhanced packet block
+
+	char *dst = _map + _pos;
+
+	put32(dst, PCAPNG_ENHANCED_PACKET);
+	put32(dst + 4, block);
+	put32(dst + 8, component - 1);
+	put32(dst + 12, (uint64_t) now >> 32);
+	put32(dst + 16, (uint64_t) now & 0xffffffff);
+	put32(dst + 20, len);
+	put32(dst + 24, len);
+	memcpy(dst + 28, buf, len);
+	memset(dst + 28 + len, 0, pad4(len) - len);
+
+	dst += 28 + pad4(len);
+
+	put16(dst, PCAPNG_OPT_EPB_FLAGS);
+	put16(dst + 2, 4);
+	put32(dst + 4, direction);
+	put32(dst + 8, PCAPNG_OPT_END);
+	put32(dst + 12, block);
+
+	if(next > end) {
+		writeFiller(end, next - end);
+	}
+
+	_pos = end;
+	++_packets;
+}
+
+// helpers, call with locked mutex
+
+void Capture::writeHeader() {
+	char *dst = _map;
+
+	// section header
+
+	put32(dst, PCAPNG_SECTION_HEADER);
+	put32(dst + 4, 28);
+	put32(dst + 8, PCAPNG_BYTE_ORDER);
+	put16(dst + 12, 1);
+	put16(dst + 14, 0);
+	put64(dst + 16, (uint64_t) -1);
+	put32(dst + 24, 28);
+
+	dst += 28;
+
+	// one interface per component
+
+	for(int i = 1; i <= _components; ++i) {
+		std::string name;
+		const size_t block = interfaceName(i, name);
+
+		if(dst + block > _map + _size) {
+			_start = _size;
+			return;
+		}
+
+		put32(dst, PCAPNG_INTERFACE);
+		put32(dst + 4, block);
+		put16(dst + 8, PCAPNG_LINKTYPE_USER0);
+		put16(dst + 10, 0);
+		put32(dst + 12, 0);
+
+		put16(dst + 16, PCAPNG_OPT_IF_NAME);
+		put16(dst + 18, name.size());
+		memset(dst + 20, 0, pad4(name.size()));
+		memcpy(dst + 20, name.data(), name.size());
+
+		put32(dst + 20 + pad4(name.size()), PCAPNG_OPT_END);
+		put32(dst + block - 4, block);
+
+		dst += block;
+	}
+
+	_start = dst - _map;
+}
+
+void Capture::writeFiller(size_t offset, size_t len) {
+	char *dst = _map + offset;
+
+	put32(dst, PCAPNG_FILLER);
+	put32(dst + 4, len);
+	put32(dst + len - 4, len);
+}
+
+size_t Capture::blockLength(size_t offset) {
+	uint32_t len;
+	memcpy(&len, _map + offset + 4, sizeof(len));
+	return len;
+}
@@ -0,0 +1,49 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H 
+
+#include <mutex>
+#include <string>
+#include <stdint.h>
+
+enum CaptureDirection {
+	CAPTURE_INBOUND = 1,
+	CAPTURE_OUTBOUND = 2,
+};
+
+// writes packets into a memory-mapped pcapng file of fixed size, overwriting the oldest packets when full
+
+class Capture {
+	public:
+		Capture(int components);
+		~Capture();
+
+		bool open(const std::string& path, size_t size);
+		void close();
+
+		void write(CaptureDirection direction, int component, const char* buf, size_t len);
+
+		size_t packets() { return _packets; }
+		size_t dropped() { return _dropped; }
+
+	private:
+		void writeHeader();
+		void writeFiller(size_t offset, size_t len);
+		size_t blockLength(size_t offset);
+
+		int _components;
+
+		std::mutex _mutex;
+
+		int _fd;
+		char *_map;
+		size_t _size;
+
+		// start of packet area and current write position
+		size_t _start;
+		size_t _pos;
+
+		size_t _packets;
+		size_t _dropped;
+};
+
+#endif /* CAPTURE_H */
@@ -1,5 +0,0 @@
-#include "helper.h"
-
-#ifdef DO_DEBUG
-std::mutex log_mutex;
-#endif
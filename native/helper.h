@@ -2,20 +2,21 @@
 #define HELPER_H 
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <string.h>
+
+#include <nice/nice.h>
 
 #define STRINGIFY(x)	#x
 #define TOSTRING(x)	STRINGIFY(x)
 
 #define AT()		__FILE__ ":" TOSTRING(__LINE__)
 
-#ifdef DO_DEBUG
-#include <iostream>
-#include <mutex>
-extern std::mutex log_mutex;
-#define DEBUG(x) do { std::lock_guard<std::mutex> guard(log_mutex); std::cerr << "[libnice] " << x << " (@" << AT() << ")" << std::endl; } while (0)
-#else
-#define DEBUG(x)
-#endif
+#include "trace.h"
+
+// only formats the message if the level of the category is enabled at runtime
+#define TRACE(category, level, x) do { if(trace_enabled(category, level)) { std::ostringstream trace_out; trace_out << x << " (@" << AT() << ")"; trace_write(category, level, trace_out.str()); } } while (0)
 
 static inline std::string trim(const std::string& str, const std::string& target=" \r\n\t") {
 	const size_t first = str.find_first_not_of(target);
@@ -28,4 +29,47 @@ static inline std::string trim(const std::string& str, const std::string& target
 	}
 }
 
+static inline void sanitize_candidate_sdp(std::string& sdp) {
+	// libnice only understands upper case transports
+
+	size_t small_udp = sdp.find(" udp ");
+
+	if(small_udp != std::string::npos) {
+		sdp.replace(small_udp, 5, " UDP ");
+	}
+}
+
+typedef std::shared_ptr<std::vector<char>> shared_buffer;
+
+static inline shared_buffer copy_buffer(const char* buf, size_t len) {
+	auto res = std::make_shared<std::vector<char>>(len);
+	memcpy(res->data(), buf, len);
+	return res;
+}
+
+static inline const char* state_to_string(int state_) {
+	// to get notified if we miss a state
+	const NiceComponentState state = (NiceComponentState) state_;
+
+	switch(state) {
+		case NICE_COMPONENT_STATE_DISCONNECTED:
+			return "disconnected";
+		case NICE_COMPONENT_STATE_GATHERING:
+			return "gathering";
+		case NICE_COMPONENT_STATE_CONNECTING:
+			return "connecting";
+		case NICE_COMPONENT_STATE_CONNECTED:
+			return "connected";
+		case NICE_COMPONENT_STATE_READY:
+			return "ready";
+		case NICE_COMPONENT_STATE_FAILED:
+			return "failed";
+		case NICE_COMPONENT_STATE_LAST:
+			// not really a state
+			break;
+	}
+
+	return "unknown";
+}
+
 #endif /* HELPER_H */
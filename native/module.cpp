@@ -1,16 +1,105 @@
 #include <node.h>
 #include <v8.h>
+#include <string.h>
 
 #include "agent.h"
 #include "stream.h"
+#include "trace.h"
 
 using namespace v8;
 
+static bool getTraceLevel(Handle<Value> value, TraceLevel& level) {
+	if(value->IsNumber()) {
+		int num = value->IntegerValue();
+
+		if(num < TRACE_OFF || num > TRACE_DEBUG) {
+			return false;
+		}
+
+		level = (TraceLevel) num;
+		return true;
+	}
+
+	v8::String::Utf8Value name(value->ToString());
+	const char* names[] = { "off", "error", "info", "debug" };
+
+	for(int i = TRACE_OFF; i <= TRACE_DEBUG; ++i) {
+		if(strcmp(*name, names[i]) == 0) {
+			level = (TraceLevel) i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static Handle<Value> setTraceLevel(const Arguments& args) {
+	HandleScope scope;
+
+	v8::String::Utf8Value name(args[0]->ToString());
+
+	TraceLevel level;
+
+	if(!getTraceLevel(args[1], level)) {
+		return ThrowException(Exception::TypeError(String::New("Unknown trace level")));
+	}
+
+	if(strcmp(*name, "all") == 0) {
+		for(int i = 0; i < TRACE_CATEGORIES; ++i) {
+			trace_set_level((TraceCategory) i, level);
+		}
+
+		return scope.Close(Undefined());
+	}
+
+	TraceCategory category;
+
+	if(!trace_category_by_name(*name, category)) {
+		return ThrowException(Exception::TypeError(String::New("Unknown trace category")));
+	}
+
+	trace_set_level(category, level);
+
+	return scope.Close(Undefined());
+}
+
+static Handle<Value> drainTrace(const Arguments& args) {
+	HandleScope scope;
+
+	trace_records records;
+	trace_drain(records);
+
+	Local<Array> res = Array::New(records.size());
+
+	for(size_t i = 0; i < records.size(); ++i) {
+		const TraceRecord& record = records[i];
+
+		Local<Object> entry = Object::New();
+		entry->Set(String::New("time"), Number::New(record.time / 1000.0));
+		entry->Set(String::New("category"), String::New(trace_category_name(record.category)));
+		entry->Set(String::New("level"), Integer::New(record.level));
+		entry->Set(String::New("message"), String::New(record.message.data(), record.message.size()));
+
+		res->Set(i, entry);
+	}
+
+	return scope.Close(res);
+}
+
+static Handle<Value> traceDropped(const Arguments& args) {
+	HandleScope scope;
+
+	return scope.Close(Number::New(trace_dropped()));
+}
+
 extern "C"
 void initAll(Handle<Object> exports) {
 	Agent::init(exports);
 	Stream::init(exports);
+
+	exports->Set(String::NewSymbol("setTraceLevel"), FunctionTemplate::New(setTraceLevel)->GetFunction());
+	exports->Set(String::NewSymbol("drainTrace"), FunctionTemplate::New(drainTrace)->GetFunction());
+	exports->Set(String::NewSymbol("traceDropped"), FunctionTemplate::New(traceDropped)->GetFunction());
 }
 
 NODE_MODULE(native_libnice, initAll)
-
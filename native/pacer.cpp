@@ -0,0 +1,180 @@
+#include "pacer.h"
+
+#include <algorithm>
+
+#include "helper.h"
+
+// granularity of the timer draining the queue in milliseconds
+#define PACER_INTERVAL 2
+
+Pacer::Pacer(NiceAgent *agent, GMainContext *context, int stream_id, int component)
+	: _agent(agent), _context(context), _stream_id(stream_id), _component(component),
+	_rate(0), _burst(0), _limit(0), _tokens(0), _last_refill(g_get_monotonic_time()),
+	_dropped(0), _source(NULL) {
+}
+
+Pacer::~Pacer() {
+	TRACE(TRACE_SEND, TRACE_DEBUG, "pacer of component " << _component << " on stream " << _stream_id << " is dying");
+}
+
+void Pacer::configure(int rate, int burst, size_t limit) {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	refill(g_get_monotonic_time());
+
+	_rate = rate;
+	_burst = burst;
+	_limit = limit;
+
+	_tokens = std::min(_tokens, _burst);
+}
+
+int Pacer::send(const char* buf, size_t size) {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	gint64 now = g_get_monotonic_time();
+
+	refill(now);
+
+	// send right away if nothing is waiting and we have tokens left
+
+	if(_queue.empty() && _tokens >= 0) {
+		_tokens -= size;
+		return nice_agent_send(_agent, _stream_id, _component, size, buf);
+	}
+
+	if(_queue.size() >= _limit) {
+		++_dropped;
+		return -1;
+	}
+
+	_queue.push_back(PacedPacket());
+
+	PacedPacket& packet = _queue.back();
+	packet.queued = now;
+	packet.data.assign(buf, buf + size);
+
+	schedule();
+
+	return size;
+}
+
+void Pacer::flush() {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	while(!_queue.empty()) {
+		PacedPacket& packet = _queue.front();
+		nice_agent_send(_agent, _stream_id, _component, packet.data.size(), packet.data.data());
+		_queue.pop_front();
+	}
+
+	unschedule();
+}
+
+void Pacer::stop() {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	_queue.clear();
+
+	unschedule();
+}
+
+double Pacer::queueDelay() {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	if(_queue.empty()) {
+		return 0;
+	}
+
+	return (g_get_monotonic_time() - _queue.front().queued) / 1000.0;
+}
+
+size_t Pacer::queued() {
+	std::lock_guard<std::mutex> guard(_mutex);
+	return _queue.size();
+}
+
+size_t Pacer::dropped() {
+	std::lock_guard<std::mutex> guard(_mutex);
+	return _dropped;
+}
+
+size_t Pacer::memoryUsage() {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	size_t res = sizeof(*this);
+
+	for(auto it = _queue.begin(); it != _queue.end(); ++it) {
+		res += sizeof(PacedPacket) + it->data.capacity();
+	}
+
+	return res;
+}
+
+// timer running in the glib thread
+
+gboolean Pacer::tick(gpointer user_data) {
+	Pacer *pacer = reinterpret_cast<std::shared_ptr<Pacer>*>(user_data)->get();
+
+	std::lock_guard<std::mutex> guard(pacer->_mutex);
+
+	// might have been replaced or stopped while we were waiting for the lock
+
+	if(g_source_is_destroyed(g_main_current_source())) {
+		return FALSE;
+	}
+
+	pacer->refill(g_get_monotonic_time());
+	pacer->drain();
+
+	if(pacer->_queue.empty()) {
+		pacer->unschedule();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void Pacer::release(gpointer user_data) {
+	delete reinterpret_cast<std::shared_ptr<Pacer>*>(user_data);
+}
+
+// helper, call with locked mutex
+
+void Pacer::refill(gint64 now) {
+	_tokens = std::min(_burst, _tokens + _rate * (now - _last_refill) / G_USEC_PER_SEC);
+	_last_refill = now;
+}
+
+void Pacer::drain() {
+	while(!_queue.empty() && _tokens >= 0) {
+		PacedPacket& packet = _queue.front();
+
+		_tokens -= packet.data.size();
+		nice_agent_send(_agent, _stream_id, _component, packet.data.size(), packet.data.data());
+
+		_queue.pop_front();
+	}
+}
+
+void Pacer::schedule() {
+	if(_source != NULL) {
+		return;
+	}
+
+	// the source keeps us alive while it is attached
+
+	_source = g_timeout_source_new(PACER_INTERVAL);
+	g_source_set_callback(_source, tick, new std::shared_ptr<Pacer>(shared_from_this()), release);
+	g_source_attach(_source, _context);
+}
+
+void Pacer::unschedule() {
+	if(_source == NULL) {
+		return;
+	}
+
+	g_source_destroy(_source);
+	g_source_unref(_source);
+	_source = NULL;
+}
@@ -0,0 +1,75 @@
+#ifndef PACER_H
+#define PACER_H 
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <glib.h>
+#include <nice/nice.h>
+
+struct PacedPacket {
+	gint64 queued;
+	std::vector<char> data;
+};
+
+typedef std::deque<PacedPacket> packet_queue;
+
+// token bucket in front of nice_agent_send(), drained by a timer on the glib loop of the agent
+
+class Pacer : public std::enable_shared_from_this<Pacer> {
+	public:
+		Pacer(NiceAgent *agent, GMainContext *context, int stream_id, int component);
+		~Pacer();
+
+		// rate in bytes per second, burst in bytes, limit in packets
+		void configure(int rate, int burst, size_t limit);
+
+		// returns the result of nice_agent_send(), the size if queued or -1 if dropped
+		int send(const char* buf, size_t size);
+
+		// send everything still queued and stop the timer
+		void flush();
+		// drop everything still queued and stop the timer
+		void stop();
+
+		// age of the oldest queued packet in milliseconds
+		double queueDelay();
+		size_t queued();
+		size_t dropped();
+
+		// estimate of the memory used including queued packets in bytes
+		size_t memoryUsage();
+
+	private:
+		static gboolean tick(gpointer user_data);
+		static void release(gpointer user_data);
+
+		void refill(gint64 now);
+		void drain();
+		void schedule();
+		void unschedule();
+
+		NiceAgent *_agent;
+		GMainContext *_context;
+
+		int _stream_id;
+		int _component;
+
+		std::mutex _mutex;
+
+		double _rate;
+		double _burst;
+		size_t _limit;
+
+		double _tokens;
+		gint64 _last_refill;
+
+		packet_queue _queue;
+		size_t _dropped;
+
+		GSource *_source;
+};
+
+#endif /* PACER_H */
@@ -0,0 +1,100 @@
+#include "pair_cache.h"
+
+#include <sstream>
+
+#include "helper.h"
+
+static std::string candidate_address(const NiceCandidate *candidate) {
+	gchar address[NICE_ADDRESS_STRING_LEN];
+	nice_address_to_string(&candidate->addr, address);
+	return address;
+}
+
+bool CachedPair::matches(const NiceCandidate *candidate) const {
+	return valid() && type == candidate->type && port == nice_address_get_port(&candidate->addr) && address == candidate_address(candidate);
+}
+
+PairCache::PairCache() : _max_age(0), _max_entries(0), _hits(0), _misses(0), _stale(0) {
+}
+
+void PairCache::configure(int max_age, size_t max_entries) {
+	_max_age = (gint64) max_age * 1000;
+	_max_entries = max_entries;
+
+	if(!enabled()) {
+		_entries.clear();
+	}
+}
+
+bool PairCache::lookup(const std::string& peer, int component, CachedPair& pair) {
+	auto it = _entries.find(key(peer, component));
+
+	if(it == _entries.end()) {
+		++_misses;
+		return false;
+	}
+
+	if(g_get_monotonic_time() - it->second.time > _max_age) {
+		TRACE(TRACE_AGENT, TRACE_DEBUG, "cached pair of component " << component << " for '" << peer << "' expired");
+		_entries.erase(it);
+		++_stale;
+		++_misses;
+		return false;
+	}
+
+	pair = it->second;
+
+	return true;
+}
+
+void PairCache::store(const std::string& peer, int component, const NiceCandidate *remote) {
+	gint64 now = g_get_monotonic_time();
+
+	CachedPair& pair = _entries[key(peer, component)];
+
+	if(pair.valid() && !pair.matches(remote)) {
+		TRACE(TRACE_AGENT, TRACE_DEBUG, "cached pair of component " << component << " for '" << peer << "' was not selected");
+		++_stale;
+	}
+
+	pair.address = candidate_address(remote);
+	pair.port = nice_address_get_port(&remote->addr);
+	pair.type = remote->type;
+	pair.time = now;
+
+	if(_entries.size() > _max_entries) {
+		expire(now);
+	}
+}
+
+// helper
+
+std::string PairCache::key(const std::string& peer, int component) {
+	std::ostringstream out;
+	out << component << ":" << peer;
+	return out.str();
+}
+
+void PairCache::expire(gint64 now) {
+	// drop expired entries, then the oldest ones until we are within the limit
+
+	for(auto it = _entries.begin(); it != _entries.end();) {
+		if(now - it->second.time > _max_age) {
+			it = _entries.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	while(_entries.size() > _max_entries) {
+		auto oldest = _entries.begin();
+
+		for(auto it = _entries.begin(); it != _entries.end(); ++it) {
+			if(it->second.time < oldest->second.time) {
+				oldest = it;
+			}
+		}
+
+		_entries.erase(oldest);
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef PAIR_CACHE_H
+#define PAIR_CACHE_H 
+
+#include <map>
+#include <string>
+#include <stdint.h>
+
+#include <glib.h>
+#include <nice/nice.h>
+
+struct CachedPair {
+	CachedPair() : port(0), type(NICE_CANDIDATE_TYPE_HOST), time(0) {}
+
+	bool valid() const { return port != 0; }
+	bool matches(const NiceCandidate *candidate) const;
+
+	// remote side of the last selected pair
+	std::string address;
+	guint port;
+	NiceCandidateType type;
+
+	gint64 time;
+};
+
+// remembers the remote candidates selected for a peer to check them first on the next connection
+
+class PairCache {
+	public:
+		PairCache();
+
+		// max_age in milliseconds, 0 disables the cache
+		void configure(int max_age, size_t max_entries);
+		bool enabled() { return _max_age > 0; }
+
+		// counts a miss if nothing fresh is cached
+		bool lookup(const std::string& peer, int component, CachedPair& pair);
+		// counts a stale entry if another pair than the cached one was selected
+		void store(const std::string& peer, int component, const NiceCandidate *remote);
+
+		void hit() { ++_hits; }
+
+		uint64_t hits() { return _hits; }
+		uint64_t misses() { return _misses; }
+		uint64_t stale() { return _stale; }
+		size_t size() { return _entries.size(); }
+
+	private:
+		typedef std::map<std::string, CachedPair> pair_map;
+
+		static std::string key(const std::string& peer, int component);
+
+		void expire(gint64 now);
+
+		gint64 _max_age;
+		size_t _max_entries;
+
+		pair_map _entries;
+
+		uint64_t _hits;
+		uint64_t _misses;
+		uint64_t _stale;
+};
+
+#endif /* PAIR_CACHE_H */
@@ -2,6 +2,16 @@
 
 #include <node_buffer.h>
 #include <glib.h>
+#include <gio/gio.h>
+
+#include <map>
+#include <fstream>
+#include <errno.h>
+#include <stdlib.h>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
 
 #include "agent.h"
 #include "helper.h"
@@ -12,29 +22,76 @@ v8::Persistent<v8::Function> Stream::constructor;
 
 // helper
 
-const char* state_to_string(int state_) {
-	// to get notified if we miss a state
-	const NiceComponentState state = (NiceComponentState) state_;
+typedef std::map<unsigned long, long> drop_map;
+
+static bool parse_number(const std::string& str, int base, long& value) {
+	const char* begin = str.c_str();
+	char* end;
+
+	errno = 0;
+	value = strtol(begin, &end, base);
+
+	return errno == 0 && end != begin && *end == '\0';
+}
+
+static void read_socket_drops(drop_map& drops) {
+#ifdef __linux__
+	// the kernel only reports drops per socket in the proc tables, keyed by inode
+
+	const char* tables[] = { "/proc/net/udp", "/proc/net/udp6" };
+
+	for(const char* table : tables) {
+		std::ifstream file(table);
+		std::string line;
+
+		// skip header
+		std::getline(file, line);
+
+		while(std::getline(file, line)) {
+			std::istringstream fields(line);
+			std::vector<std::string> tokens;
+			std::string token;
+
+			while(fields >> token) {
+				tokens.push_back(token);
+			}
+
+			// sl local rem st queues tr retrnsmt uid timeout inode ref pointer drops
+			if(tokens.size() < 13) {
+				continue;
+			}
+
+			long inode, count;
+
+			if(parse_number(tokens[9], 10, inode) && parse_number(tokens.back(), 10, count)) {
+				drops[inode] = count;
+			}
+		}
+	}
+#endif
+}
+
+static long socket_drops(int fd, const drop_map& drops) {
+	struct stat info;
+
+	if(fstat(fd, &info) != 0) {
+		return -1;
+	}
+
+	auto it = drops.find(info.st_ino);
 
-	switch(state) {
-		case NICE_COMPONENT_STATE_DISCONNECTED:
-			return "disconnected";
-		case NICE_COMPONENT_STATE_GATHERING:
-			return "gathering";
-		case NICE_COMPONENT_STATE_CONNECTING:
-			return "connecting";
-		case NICE_COMPONENT_STATE_CONNECTED:
-			return "connected";
-		case NICE_COMPONENT_STATE_READY:
-			return "ready";
-		case NICE_COMPONENT_STATE_FAILED:
-			return "failed";
-		case NICE_COMPONENT_STATE_LAST:
-			// not really a state
-			break;
+	return it != drops.end() ? it->second : -1;
+}
+
+static int socket_buffer(int fd, int option) {
+	int value = 0;
+	socklen_t len = sizeof(value);
+
+	if(getsockopt(fd, SOL_SOCKET, option, &value, &len) != 0) {
+		return -1;
 	}
 
-	return "unknown";
+	return value;
 }
 
 // lifecycle
@@ -52,6 +109,16 @@ void Stream::init(v8::Handle<v8::Object> exports) {
 	NODE_SET_PROTOTYPE_METHOD(tpl, "getLocalIceCandidates", getLocalIceCandidates);
 	NODE_SET_PROTOTYPE_METHOD(tpl, "send", send);
 	NODE_SET_PROTOTYPE_METHOD(tpl, "setTos", setTos);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "setRelayInfo", setRelayInfo);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "setPortRange", setPortRange);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "setSocketBuffers", setSocketBuffers);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "getStats", getStats);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "setPacing", setPacing);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "startCapture", startCapture);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "stopCapture", stopCapture);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "getTimeline", getTimeline);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "setTimelineEvent", setTimelineEvent);
+	NODE_SET_PROTOTYPE_METHOD(tpl, "setPeerKey", setPeerKey);
 	NODE_SET_PROTOTYPE_METHOD(tpl, "close", close);
 	constructor = Persistent<Function>::New(tpl->GetFunction());
 	// export
@@ -59,17 +126,24 @@ void Stream::init(v8::Handle<v8::Object> exports) {
 }
 
 Stream::Stream(Handle<Object> js_agent, int stream_id, int components)
-	: _js_agent(Persistent<Object>::New(js_agent)), _stream_id(stream_id), _components(components) {
-	DEBUG("stream " << stream_id << " with " << components << " components created");
+	: _js_agent(Persistent<Object>::New(js_agent)), _stream_id(stream_id), _components(components), _pairs_loaded(false),
+	_created(g_get_monotonic_time()),
+	_first_sent(false), _first_received(false), _timeline_event(false), _timeline_done(false),
+	_attached(false), _trimmed(false), _working(0) {
+	TRACE(TRACE_STREAM, TRACE_INFO, "stream " << stream_id << " with " << components << " components created");
 	Agent *agent = node::ObjectWrap::Unwrap<Agent>(js_agent);
 	_nice_agent = agent->agent();
+	_attached = !agent->lowMemory();
 }
 
 Stream::~Stream() {
-	DEBUG("stream " << _stream_id << " is dying");
+	TRACE(TRACE_STREAM, TRACE_INFO, "stream " << _stream_id << " is dying");
 
 	Agent *agent = node::ObjectWrap::Unwrap<Agent>(_js_agent);
 
+	stopPacers();
+	stopCapture();
+
 	agent->removeStream(_stream_id);
 
 	_js_agent.Dispose();
@@ -77,9 +151,21 @@ Stream::~Stream() {
 
 // callback forwarder
 
-void Stream::receive(int component, const char* buf, size_t size) {
+void Stream::receive(int component, const char* buf, size_t size, gint64 time) {
 	HandleScope scope;
 
+	if(!_first_received) {
+		_first_received = true;
+		addTimeline("firstReceived", component, time);
+	}
+
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(_js_agent);
+
+	if(agent->multiplexReceive()) {
+		agent->emitReceive(_stream_id, component, buf, size);
+		return;
+	}
+
 	const int argc = 3;
 	Handle<Value> argv[argc] = {
 		String::New("receive"),
@@ -90,11 +176,26 @@ void Stream::receive(int component, const char* buf, size_t size) {
 	node::MakeCallback(handle_, "emit", argc, argv);
 }
 
-void Stream::stateChanged(int component, int state) {
+void Stream::stateChanged(int component, int state, gint64 time) {
 	HandleScope scope;
 
+	addTimeline(state_to_string(state), component, time);
+
+	if(component >= 1 && component <= _components) {
+		if(_states.empty()) {
+			_states.assign(_components + 1, NICE_COMPONENT_STATE_DISCONNECTED);
+		}
+
+		_states[component] = state;
+	}
+
 	if(state == NICE_COMPONENT_STATE_DISCONNECTED || state == NICE_COMPONENT_STATE_FAILED) {
-		_working.erase(component);
+		_working &= ~(((uint64_t) 1) << (component - 1));
+	}
+
+	if(state == NICE_COMPONENT_STATE_READY) {
+		applySocketOptions(component);
+		storeSelectedPair(component);
 	}
 
 	checkIndependence();
@@ -107,11 +208,21 @@ void Stream::stateChanged(int component, int state) {
 	};
 
 	node::MakeCallback(handle_, "emit", argc, argv);
+
+	checkTimelineDone();
+
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(_js_agent);
+
+	if(_timeline_done && agent->lowMemory()) {
+		trim();
+	}
 }
 
-void Stream::gatheringDone() {
+void Stream::gatheringDone(gint64 time) {
 	HandleScope scope;
 
+	addTimeline("gatheringDone", 0, time);
+
 	const int argc = 2;
 	Handle<Value> argv[argc] = {
 		String::New("gatheringDone"),
@@ -121,6 +232,26 @@ void Stream::gatheringDone() {
 	node::MakeCallback(handle_, "emit", argc, argv);
 }
 
+void Stream::candidateGathered(int component, gint64 time) {
+	addTimeline("candidateGathered", component, time);
+}
+
+void Stream::selectedPairChanged(int component) {
+	if(component < 1 || component > _components) {
+		return;
+	}
+
+	// the new pair might use another socket
+
+	applySocketOptions(component);
+
+	// selected again after getting ready, remember the pair in use
+
+	if(!_states.empty() && _states[component] == NICE_COMPONENT_STATE_READY) {
+		storeSelectedPair(component);
+	}
+}
+
 // js functions
 
 v8::Handle<v8::Value> Stream::New(const v8::Arguments& args) {
@@ -128,9 +259,18 @@ v8::Handle<v8::Value> Stream::New(const v8::Arguments& args) {
 
 	if (args.IsConstructCall()) {
 		// Invoked as constructor: `new MyObject(...)`
-		Stream* obj = new Stream(args[0]->ToObject(), args[1]->IntegerValue(), args[2]->IntegerValue());
+		int components = args[2]->IntegerValue();
+
+		if(components < 1 || components > max_components) {
+			return ThrowException(Exception::RangeError(String::New("Invalid component count")));
+		}
+
+		Stream* obj = new Stream(args[0]->ToObject(), args[1]->IntegerValue(), components);
 		obj->Wrap(args.This());
 
+		// needed to route received data when multiplexing on the agent
+		args.This()->Set(String::NewSymbol("id"), args[1]);
+
 		return args.This();
 	} else {
 		// Invoked as plain function `MyObject(...)`, turn into construct call.
@@ -147,8 +287,18 @@ v8::Handle<v8::Value> Stream::gatherCandidates(const v8::Arguments& args) {
 	NiceAgent *nice_agent = stream->_nice_agent;
 	int stream_id = stream->_stream_id;
 
+	stream->addTimeline("gatherCandidates");
+
+	// sockets are created now, so this is the latest point to listen on them
+
+	if(!stream->_attached) {
+		Agent *agent = node::ObjectWrap::Unwrap<Agent>(stream->_js_agent);
+		agent->attachReceive(stream_id, stream->_components);
+		stream->_attached = true;
+	}
+
 	for(int i = 1; i <= stream->_components; ++i) {
-		stream->_working.insert(i);
+		stream->_working |= ((uint64_t) 1) << (i - 1);
 	}
 
 	stream->checkIndependence();
@@ -168,7 +318,13 @@ v8::Handle<v8::Value> Stream::setRemoteCredentials(const v8::Arguments& args) {
 	v8::String::Utf8Value ufrag(args[0]->ToString());
 	v8::String::Utf8Value pwd(args[1]->ToString());
 
-	DEBUG("set remote credentials on stream " << stream_id << " to " << *ufrag << " " << *pwd);
+	TRACE(TRACE_STREAM, TRACE_DEBUG, "set remote credentials on stream " << stream_id << " to ufrag " << *ufrag);
+
+	stream->addTimeline("setRemoteCredentials");
+
+	// identifies the peer unless the application sets a key
+
+	stream->_remote_ufrag = *ufrag;
 
 	bool res = nice_agent_set_remote_credentials(nice_agent, stream_id, *ufrag, *pwd);
 
@@ -190,7 +346,7 @@ v8::Handle<v8::Value> Stream::getLocalCredentials(const v8::Arguments& args) {
 	res->Set(String::New("ufrag"), String::New(ufrag));
 	res->Set(String::New("pwd"), String::New(pwd));
 
-	DEBUG("local credentials are '" << ufrag << "' and '" << pwd << "'");
+	TRACE(TRACE_STREAM, TRACE_DEBUG, "local ufrag is '" << ufrag << "'");
 
 	g_free(ufrag);
 	g_free(pwd);
@@ -238,9 +394,28 @@ v8::Handle<v8::Value> Stream::send(const v8::Arguments& args) {
 	size_t size = node::Buffer::Length(buffer);
 	char* buf = node::Buffer::Data(buffer);
 
-	//DEBUG("sending " << size << " bytes");
+	TRACE(TRACE_SEND, TRACE_DEBUG, "sending " << size << " bytes on component " << component << " of stream " << stream_id);
+
+	const bool valid_component = component >= 1 && component <= stream->_components;
+
+	if(stream->_capture && valid_component) {
+		stream->_capture->write(CAPTURE_OUTBOUND, component, buf, size);
+	}
+
+	int ret;
+
+	if(valid_component && !stream->_pacers.empty() && stream->_pacers[component]) {
+		ret = stream->_pacers[component]->send(buf, size);
+	} else {
+		ret = nice_agent_send(nice_agent, stream_id, component, size, buf);
+	}
+
+	// only a packet which was actually sent or queued counts
 
-	int ret = nice_agent_send(nice_agent, stream_id, component, size, buf);
+	if(ret >= 0 && !stream->_first_sent) {
+		stream->_first_sent = true;
+		stream->addTimeline("firstSent", component);
+	}
 
 	return scope.Close(Integer::New(ret));
 }
@@ -259,6 +434,253 @@ v8::Handle<v8::Value> Stream::setTos(const v8::Arguments& args) {
 	return scope.Close(Undefined());
 }
 
+v8::Handle<v8::Value> Stream::setRelayInfo(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Stream *stream = node::ObjectWrap::Unwrap<Stream>(args.This()->ToObject());
+	NiceAgent *nice_agent = stream->_nice_agent;
+	int stream_id = stream->_stream_id;
+
+	int component = args[0]->IntegerValue();
+
+	NiceRelayType type;
+
+	if(!Agent::getRelayType(args[5], type)) {
+		return ThrowException(Exception::TypeError(String::New("Unknown relay type")));
+	}
+
+	v8::String::Utf8Value server(args[1]->ToString());
+	int port = args[2]->IntegerValue();
+	v8::String::Utf8Value username(args[3]->ToString());
+	v8::String::Utf8Value password(args[4]->ToString());
+
+	TRACE(TRACE_STREAM, TRACE_DEBUG, "set relay on component " << component << " of stream " << stream_id << " to " << *server << ":" << port);
+
+	bool res = nice_agent_set_relay_info(nice_agent, stream_id, component, *server, port, *username, *password, type);
+
+	return scope.Close(Boolean::New(res));
+}
+
+v8::Handle<v8::Value> Stream::setPortRange(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Stream *stream = node::ObjectWrap::Unwrap<Stream>(args.This()->ToObject());
+	NiceAgent *nice_agent = stream->_nice_agent;
+	int stream_id = stream->_stream_id;
+
+	int component = args[0]->IntegerValue();
+	int min_port = args[1]->IntegerValue();
+	int max_port = args[2]->IntegerValue();
+
+	TRACE(TRACE_STREAM, TRACE_DEBUG, "set port range of component " << component << " on stream " << stream_id << " to " << min_port << "-" << max_port);
+
+	nice_agent_set_port_range(nice_agent, stream_id, component, min_port, max_port);
+
+	return scope.Close(Undefined());
+}
+
+v8::Handle<v8::Value> Stream::setSocketBuffers(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Stream *stream = node::ObjectWrap::Unwrap<Stream>(args.This()->ToObject());
+
+	int component = args[0]->IntegerValue();
+
+	if(component < 1 || component > stream->_components) {
+		return ThrowException(Exception::RangeError(String::New("Invalid component")));
+	}
+
+	if(stream->_socket_options.empty()) {
+		stream->_socket_options.resize(stream->_components + 1);
+	}
+
+	SocketOptions& options = stream->_socket_options[component];
+	options.rcvbuf = args[1]->IsUndefined() ? 0 : args[1]->IntegerValue();
+	options.sndbuf = args[2]->IsUndefined() ? 0 : args[2]->IntegerValue();
+
+	// sockets might already be there, otherwise applied when ready
+
+	stream->applySocketOptions(component);
+
+	return scope.Close(Undefined());
+}
+
+v8::Handle<v8::Value> Stream::getStats(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Stream *stream = node::ObjectWrap::Unwrap<Stream>(args.This()->ToObject());
+
+	Local<Object> res = Object::New();
+
+	// read the drop counters once for all components
+	drop_map drops;
+	bool drops_read = false;
+
+	for(int i = 1; i <= stream->_components; ++i) {
+		Local<Object> stats = Object::New();
+
+		GSocket *socket = nice_agent_get_selected_socket(stream->_nice_agent, stream->_stream_id, i);
+
+		if(socket != NULL) {
+			int fd = g_socket_get_fd(socket);
+
+			stats->Set(String::New("rcvbuf"), Integer::New(socket_buffer(fd, SO_RCVBUF)));
+			stats->Set(String::New("sndbuf"), Integer::New(socket_buffer(fd, SO_SNDBUF)));
+			if(!drops_read) {
+				read_socket_drops(drops);
+				drops_read = true;
+			}
+
+			stats->Set(String::New("drops"), Number::New(socket_drops(fd, drops)));
+
+			g_object_unref(socket);
+		}
+
+		if(!stream->_pacers.empty() && stream->_pacers[i]) {
+			auto& pacer = stream->_pacers[i];
+
+			stats->Set(String::New("queueDelay"), Number::New(pacer->queueDelay()));
+			stats->Set(String::New("queued"), Number::New(pacer->queued()));
+			stats->Set(String::New("paceDropped"), Number::New(pacer->dropped()));
+		}
+
+		res->Set(Integer::New(i), stats);
+	}
+
+	return scope.Close(res);
+}
+
+v8::Handle<v8::Value> Stream::setPacing(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Stream *stream = node::ObjectWrap::Unwrap<Stream>(args.This()->ToObject());
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(stream->_js_agent);
+
+	int component = args[0]->IntegerValue();
+
+	if(component < 1 || component > stream->_components) {
+		return ThrowException(Exception::RangeError(String::New("Invalid component")));
+	}
+
+	int rate = args[1]->IsUndefined() ? 0 : args[1]->IntegerValue();
+
+	// disable pacing, but do not lose what is already queued
+
+	if(rate <= 0) {
+		if(!stream->_pacers.empty() && stream->_pacers[component]) {
+			auto& pacer = stream->_pacers[component];
+
+			pacer->flush();
+			pacer.reset();
+		}
+
+		return scope.Close(Undefined());
+	}
+
+	int burst = args[2]->IsUndefined() ? rate / 10 : args[2]->IntegerValue();
+	int limit = args[3]->IsUndefined() ? 1000 : args[3]->IntegerValue();
+
+	if(burst < 0) {
+		return ThrowException(Exception::RangeError(String::New("Invalid burst size")));
+	}
+
+	if(limit < 0) {
+		return ThrowException(Exception::RangeError(String::New("Invalid queue limit")));
+	}
+
+	TRACE(TRACE_SEND, TRACE_INFO, "pacing component " << component << " of stream " << stream->_stream_id << " at " << rate << " bytes/s");
+
+	if(stream->_pacers.empty()) {
+		stream->_pacers.resize(stream->_components + 1);
+	}
+
+	auto& pacer = stream->_pacers[component];
+
+	if(!pacer) {
+		pacer = std::make_shared<Pacer>(stream->_nice_agent, agent->context(), stream->_stream_id, component);
+	}
+
+	pacer->configure(rate, burst, limit);
+
+	return scope.Close(Undefined());
+}
+
+v8::Handle<v8::Value> Stream::startCapture(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Stream *stream = node::ObjectWrap::Unwrap<Stream>(args.This()->ToObject());
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(stream->_js_agent);
+
+	v8::String::Utf8Value path(args[0]->ToString());
+
+	size_t max_bytes = 16 * 1024 * 1024;
+
+	if(args[1]->IsObject()) {
+		Local<Value> value = args[1]->ToObject()->Get(String::New("maxBytes"));
+
+		if(!value->IsUndefined()) {
+			max_bytes = value->IntegerValue();
+		}
+	}
+
+	stream->stopCapture();
+
+	auto capture = std::make_shared<Capture>(stream->_components);
+
+	if(!capture->open(*path, max_bytes)) {
+		return ThrowException(Exception::Error(String::New("Unable to open capture file")));
+	}
+
+	TRACE(TRACE_STREAM, TRACE_DEBUG, "capturing stream " << stream->_stream_id << " to '" << *path << "'");
+
+	stream->_capture = capture;
+	agent->setCapture(stream->_stream_id, capture);
+
+	return scope.Close(Undefined());
+}
+
+v8::Handle<v8::Value> Stream::stopCapture(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Stream *stream = node::ObjectWrap::Unwrap<Stream>(args.This()->ToObject());
+
+	stream->stopCapture();
+
+	return scope.Close(Undefined());
+}
+
+v8::Handle<v8::Value> Stream::getTimeline(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Stream *stream = node::ObjectWrap::Unwrap<Stream>(args.This()->ToObject());
+
+	Handle<Value> res = stream->getTimeline();
+
+	return scope.Close(res);
+}
+
+v8::Handle<v8::Value> Stream::setTimelineEvent(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Stream *stream = node::ObjectWrap::Unwrap<Stream>(args.This()->ToObject());
+
+	stream->_timeline_event = args[0]->IsUndefined() || args[0]->BooleanValue();
+
+	return scope.Close(Undefined());
+}
+
+v8::Handle<v8::Value> Stream::setPeerKey(const v8::Arguments& args) {
+	HandleScope scope;
+
+	Stream *stream = node::ObjectWrap::Unwrap<Stream>(args.This()->ToObject());
+
+	v8::String::Utf8Value key(args[0]->ToString());
+
+	stream->_peer_key = *key;
+
+	return scope.Close(Undefined());
+}
+
 v8::Handle<v8::Value> Stream::close(const v8::Arguments& args) {
 	HandleScope scope;
 
@@ -266,12 +688,15 @@ v8::Handle<v8::Value> Stream::close(const v8::Arguments& args) {
 	Agent *agent = node::ObjectWrap::Unwrap<Agent>(stream->_js_agent);
 	int stream_id = stream->_stream_id;
 
+	stream->stopPacers();
+	stream->stopCapture();
+
 	bool res = agent->removeStream(stream_id);
 
-	stream->_working.clear();
+	stream->_working = 0;
 	stream->checkIndependence();
 
-	DEBUG("closing stream " << stream->_stream_id);
+	TRACE(TRACE_STREAM, TRACE_INFO, "closing stream " << stream->_stream_id);
 
 	return scope.Close(Boolean::New(res));
 }
@@ -313,28 +738,42 @@ bool Stream::addRemoteIceCandidate(const char* sdp_) {
 
 	std::string sdp(sdp_);
 
-	DEBUG("adding candidate '" << trim(sdp) << "' to stream " << _stream_id);
+	TRACE(TRACE_STREAM, TRACE_DEBUG, "adding candidate '" << trim(sdp) << "' to stream " << _stream_id);
 
-	size_t small_udp = sdp.find(" udp ");
-
-	if(small_udp != std::string::npos) {
-		sdp.replace(small_udp, 5, " UDP ");
-	}
+	sanitize_candidate_sdp(sdp);
 
 	// parse sdp
 
 	auto nice_candidate = nice_agent_parse_remote_candidate_sdp(_nice_agent, _stream_id, sdp.c_str());
 
 	if(nice_candidate == NULL) {
-		DEBUG("was unable to parse the candidate");
+		TRACE(TRACE_STREAM, TRACE_ERROR, "was unable to parse the candidate");
 		return false;
 	}
 
 	if(nice_candidate->component_id > _components) {
-		DEBUG("component was invalid");
+		TRACE(TRACE_STREAM, TRACE_ERROR, "component was invalid");
 		return false;
 	}
 
+	addTimeline("addRemoteIceCandidate", nice_candidate->component_id);
+
+	// check the candidate selected last time first, the peer is known by now
+
+	if(!_pairs_loaded) {
+		loadCachedPairs();
+	}
+
+	if(nice_candidate->component_id < _cached_pairs.size() && _cached_pairs[nice_candidate->component_id].matches(nice_candidate)) {
+		TRACE(TRACE_STREAM, TRACE_DEBUG, "prioritizing cached candidate on component " << nice_candidate->component_id << " of stream " << _stream_id);
+
+		Agent *agent = node::ObjectWrap::Unwrap<Agent>(_js_agent);
+		agent->pairCache().hit();
+
+		nice_candidate->priority = G_MAXUINT32;
+		_cached_pairs[nice_candidate->component_id] = CachedPair();
+	}
+
 	// insert into canidate list
 
 	GSList *candidates = nice_agent_get_remote_candidates(_nice_agent, _stream_id, nice_candidate->component_id);
@@ -348,15 +787,207 @@ bool Stream::addRemoteIceCandidate(const char* sdp_) {
 	return true;
 }
 
+void Stream::applySocketOptions(int component) {
+	if(_socket_options.empty()) {
+		return;
+	}
+
+	const SocketOptions& options = _socket_options[component];
+
+	if(options.rcvbuf == 0 && options.sndbuf == 0) {
+		return;
+	}
+
+	GSocket *socket = nice_agent_get_selected_socket(_nice_agent, _stream_id, component);
+
+	if(socket == NULL) {
+		TRACE(TRACE_STREAM, TRACE_DEBUG, "no socket selected on component " << component << " of stream " << _stream_id << " yet");
+		return;
+	}
+
+	int fd = g_socket_get_fd(socket);
+
+	if(options.rcvbuf > 0 && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &options.rcvbuf, sizeof(options.rcvbuf)) != 0) {
+		TRACE(TRACE_STREAM, TRACE_ERROR, "unable to set receive buffer on component " << component << " of stream " << _stream_id);
+	}
+
+	if(options.sndbuf > 0 && setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &options.sndbuf, sizeof(options.sndbuf)) != 0) {
+		TRACE(TRACE_STREAM, TRACE_ERROR, "unable to set send buffer on component " << component << " of stream " << _stream_id);
+	}
+
+	g_object_unref(socket);
+}
+
+v8::Handle<v8::Value> Stream::getTimeline() {
+	HandleScope scope;
+
+	Local<Array> res = Array::New(_timeline.size());
+
+	for(size_t i = 0; i < _timeline.size(); ++i) {
+		const TimelineEntry& entry = _timeline[i];
+
+		Local<Object> obj = Object::New();
+		obj->Set(String::New("event"), String::New(entry.event));
+		obj->Set(String::New("time"), Number::New((entry.time - _created) / 1000.0));
+
+		if(entry.component > 0) {
+			obj->Set(String::New("component"), Integer::New(entry.component));
+		}
+
+		res->Set(i, obj);
+	}
+
+	return scope.Close(res);
+}
+
+void Stream::addTimeline(const char* event, int component, gint64 time) {
+	if(_trimmed) {
+		return;
+	}
+
+	TimelineEntry entry;
+	entry.time = time;
+	entry.event = event;
+	entry.component = component;
+
+	_timeline.push_back(entry);
+}
+
+void Stream::checkTimelineDone() {
+	if(_timeline_done || _states.empty()) {
+		return;
+	}
+
+	// done when everything is ready or anything failed
+
+	bool ready = true;
+	bool failed = false;
+
+	for(int i = 1; i <= _components; ++i) {
+		ready = ready && _states[i] == NICE_COMPONENT_STATE_READY;
+		failed = failed || _states[i] == NICE_COMPONENT_STATE_FAILED;
+	}
+
+	if(!ready && !failed) {
+		return;
+	}
+
+	_timeline_done = true;
+
+	if(!_timeline_event) {
+		return;
+	}
+
+	const int argc = 2;
+	Handle<Value> argv[argc] = {
+		String::New("timeline"),
+		getTimeline(),
+	};
+
+	node::MakeCallback(handle_, "emit", argc, argv);
+}
+
+void Stream::loadCachedPairs() {
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(_js_agent);
+	PairCache& cache = agent->pairCache();
+
+	const std::string& key = peerKey();
+
+	if(!cache.enabled() || key.empty()) {
+		return;
+	}
+
+	_pairs_loaded = true;
+	_cached_pairs.assign(_components + 1, CachedPair());
+
+	for(int i = 1; i <= _components; ++i) {
+		cache.lookup(key, i, _cached_pairs[i]);
+	}
+}
+
+void Stream::storeSelectedPair(int component) {
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(_js_agent);
+	PairCache& cache = agent->pairCache();
+
+	const std::string& key = peerKey();
+
+	if(!cache.enabled() || key.empty()) {
+		return;
+	}
+
+	NiceCandidate *local, *remote;
+
+	if(nice_agent_get_selected_pair(_nice_agent, _stream_id, component, &local, &remote)) {
+		cache.store(key, component, remote);
+	}
+}
+
+size_t Stream::memoryUsage() {
+	size_t res = sizeof(*this);
+
+	res += _socket_options.capacity() * sizeof(SocketOptions);
+	res += _pacers.capacity() * sizeof(std::shared_ptr<Pacer>);
+	res += _cached_pairs.capacity() * sizeof(CachedPair);
+	res += _timeline.capacity() * sizeof(TimelineEntry);
+	res += _states.capacity() * sizeof(int);
+	res += _peer_key.capacity();
+	res += _remote_ufrag.capacity();
+
+	for(auto it = _pacers.begin(); it != _pacers.end(); ++it) {
+		if(*it) {
+			res += (*it)->memoryUsage();
+		}
+	}
+
+	return res;
+}
+
+void Stream::trim() {
+	if(_trimmed) {
+		return;
+	}
+
+	TRACE(TRACE_STREAM, TRACE_DEBUG, "releasing setup state of stream " << _stream_id);
+
+	// the pair was already stored in the cache of the agent
+
+	timeline().swap(_timeline);
+	std::vector<CachedPair>().swap(_cached_pairs);
+	_pairs_loaded = true;
+
+	_trimmed = true;
+}
+
+void Stream::stopPacers() {
+	for(auto it = _pacers.begin(); it != _pacers.end(); ++it) {
+		if(*it) {
+			(*it)->stop();
+			it->reset();
+		}
+	}
+}
+
+void Stream::stopCapture() {
+	if(!_capture) {
+		return;
+	}
+
+	Agent *agent = node::ObjectWrap::Unwrap<Agent>(_js_agent);
+	agent->setCapture(_stream_id, std::shared_ptr<Capture>());
+
+	_capture->close();
+	_capture.reset();
+}
+
 void Stream::checkIndependence() {
-	if(_working.size() > 0) {
+	if(_working != 0) {
 		if(_self.IsEmpty()) {
-			DEBUG("stream " << _stream_id << " got independent because it has work to do");
+			TRACE(TRACE_STREAM, TRACE_DEBUG, "stream " << _stream_id << " got independent because it has work to do");
 			_self = Persistent<Object>::New(handle_);
 		}
 	} else {
 		if(!_self.IsEmpty()) {
-			DEBUG("stream " << _stream_id << " lost its independence");
+			TRACE(TRACE_STREAM, TRACE_DEBUG, "stream " << _stream_id << " lost its independence");
 			_self.Dispose();
 			_self = Persistent<Object>();
 		}
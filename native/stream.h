@@ -1,11 +1,35 @@
 #ifndef STREAM_H
 #define STREAM_H 
 
-#include <set>
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <string>
+#include <glib.h>
 #include <node.h>
 #include <v8.h>
 #include <nice/nice.h>
 
+#include "pacer.h"
+#include "capture.h"
+#include "pair_cache.h"
+
+struct SocketOptions {
+	SocketOptions() : rcvbuf(0), sndbuf(0) {}
+
+	// requested buffer sizes, 0 keeps the kernel default
+	int rcvbuf;
+	int sndbuf;
+};
+
+struct TimelineEntry {
+	gint64 time;
+	const char* event;
+	int component;
+};
+
+typedef std::vector<TimelineEntry> timeline;
+
 class Stream : public node::ObjectWrap {
 	public:
 		Stream(v8::Handle<v8::Object> js_agent, int stream_id, int components);
@@ -13,9 +37,20 @@ class Stream : public node::ObjectWrap {
 
 		static void init(v8::Handle<v8::Object> exports);
 
-		void receive(int component, const char* buf, size_t size);
-		void stateChanged(int component, int state);
-		void gatheringDone();
+		void receive(int component, const char* buf, size_t size, gint64 time);
+		void stateChanged(int component, int state, gint64 time);
+		void gatheringDone(gint64 time);
+		void candidateGathered(int component, gint64 time);
+		void selectedPairChanged(int component);
+
+		// estimate of the native memory used by this stream in bytes
+		size_t memoryUsage();
+
+		int components() { return _components; }
+		int attachedComponents() { return _attached ? _components : 0; }
+
+		// more components can not be tracked
+		static const int max_components = 64;
 
 		static v8::Persistent<v8::Function> constructor;
 
@@ -30,6 +65,16 @@ class Stream : public node::ObjectWrap {
 		static v8::Handle<v8::Value> getLocalIceCandidates(const v8::Arguments& args);
 		static v8::Handle<v8::Value> send(const v8::Arguments& args);
 		static v8::Handle<v8::Value> setTos(const v8::Arguments& args);
+		static v8::Handle<v8::Value> setRelayInfo(const v8::Arguments& args);
+		static v8::Handle<v8::Value> setPortRange(const v8::Arguments& args);
+		static v8::Handle<v8::Value> setSocketBuffers(const v8::Arguments& args);
+		static v8::Handle<v8::Value> getStats(const v8::Arguments& args);
+		static v8::Handle<v8::Value> setPacing(const v8::Arguments& args);
+		static v8::Handle<v8::Value> startCapture(const v8::Arguments& args);
+		static v8::Handle<v8::Value> stopCapture(const v8::Arguments& args);
+		static v8::Handle<v8::Value> getTimeline(const v8::Arguments& args);
+		static v8::Handle<v8::Value> setTimelineEvent(const v8::Arguments& args);
+		static v8::Handle<v8::Value> setPeerKey(const v8::Arguments& args);
 		static v8::Handle<v8::Value> close(const v8::Arguments& args);
 
 		// maybe implement later ...
@@ -38,15 +83,26 @@ class Stream : public node::ObjectWrap {
 		static v8::Handle<v8::Value> getRemoteIceCandidates(const v8::Arguments& args);
 		static v8::Handle<v8::Value> setRemoteIceCandidates(const v8::Arguments& args);
 		static v8::Handle<v8::Value> getSelectedPair(const v8::Arguments& args);
-		static v8::Handle<v8::Value> setRelayInfo(const v8::Arguments& args);
-		static v8::Handle<v8::Value> setPortRange(const v8::Arguments& args);
 		*/
 
 		// helper
 
 		v8::Handle<v8::Value> getLocalIceCandidates();
 		bool addRemoteIceCandidate(const char* sdp);
+		void applySocketOptions(int component);
+
+		v8::Handle<v8::Value> getTimeline();
+		void addTimeline(const char* event, int component=0, gint64 time=g_get_monotonic_time());
+		void checkTimelineDone();
 
+		const std::string& peerKey() { return _peer_key.empty() ? _remote_ufrag : _peer_key; }
+		void loadCachedPairs();
+		void storeSelectedPair(int component);
+
+		void trim();
+
+		void stopPacers();
+		void stopCapture();
 		void checkIndependence();
 
 		// the agent
@@ -59,9 +115,48 @@ class Stream : public node::ObjectWrap {
 		int _stream_id;
 		int _components;
 
+		// per component state below is indexed by component id and allocated on first use
+
+		// socket options
+
+		std::vector<SocketOptions> _socket_options;
+
+		// send pacing, null if disabled
+
+		std::vector<std::shared_ptr<Pacer>> _pacers;
+
+		// packet capture, shared with the agent for received packets
+
+		std::shared_ptr<Capture> _capture;
+
+		// peer for the pair cache of the agent and what it knew about it
+
+		std::string _peer_key;
+		std::string _remote_ufrag;
+		std::vector<CachedPair> _cached_pairs;
+		// looked up with the first remote candidate
+		bool _pairs_loaded;
+
+		// milestones of the connection setup
+
+		gint64 _created;
+		timeline _timeline;
+		// last state of each component
+		std::vector<int> _states;
+		bool _first_sent;
+		bool _first_received;
+		bool _timeline_event;
+		bool _timeline_done;
+
+		// receive callbacks are attached lazily in low memory mode
+		bool _attached;
+		// setup state was released after getting ready
+		bool _trimmed;
+
 		// stay alive
 		v8::Persistent<v8::Object> _self;
-		std::set<int> _working;
+		// one bit per component with work to do
+		uint64_t _working;
 };
 
 #endif /* STREAM_H */
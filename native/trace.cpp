@@ -0,0 +1,152 @@
+#include "trace.h"
+
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <string.h>
+#include <pthread.h>
+
+// records per thread, has to be a power of two
+#define TRACE_RING_SIZE		1024
+#define TRACE_MESSAGE_SIZE	232
+
+std::atomic<int> trace_levels[TRACE_CATEGORIES];
+
+struct TraceEntry {
+	int64_t time;
+	uint8_t category;
+	uint8_t level;
+	uint16_t length;
+	char message[TRACE_MESSAGE_SIZE];
+};
+
+// single producer (the owning thread), single consumer (whoever drains)
+
+struct TraceRing {
+	TraceRing() : head(0), tail(0), alive(true) {}
+
+	TraceEntry entries[TRACE_RING_SIZE];
+
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+	std::atomic<bool> alive;
+};
+
+static std::mutex trace_mutex;
+static std::vector<TraceRing*> trace_rings;
+static std::atomic<uint64_t> trace_lost(0);
+
+static pthread_key_t trace_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+
+static const char* trace_names[TRACE_CATEGORIES] = {
+	"agent",
+	"stream",
+	"recv",
+	"send",
+	"state",
+};
+
+static void trace_thread_exit(void* data) {
+	// the ring is freed by the next drain once it is empty
+	reinterpret_cast<TraceRing*>(data)->alive = false;
+}
+
+static void trace_create_key() {
+	pthread_key_create(&trace_key, trace_thread_exit);
+}
+
+static TraceRing* trace_ring() {
+	pthread_once(&trace_key_once, trace_create_key);
+
+	TraceRing *ring = reinterpret_cast<TraceRing*>(pthread_getspecific(trace_key));
+
+	if(ring == NULL) {
+		ring = new TraceRing();
+		pthread_setspecific(trace_key, ring);
+
+		std::lock_guard<std::mutex> guard(trace_mutex);
+		trace_rings.push_back(ring);
+	}
+
+	return ring;
+}
+
+void trace_write(TraceCategory category, TraceLevel level, const std::string& message) {
+	TraceRing *ring = trace_ring();
+
+	size_t head = ring->head.load(std::memory_order_relaxed);
+	size_t tail = ring->tail.load(std::memory_order_acquire);
+
+	if(head - tail >= TRACE_RING_SIZE) {
+		trace_lost.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	TraceEntry& entry = ring->entries[head & (TRACE_RING_SIZE - 1)];
+
+	entry.time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	entry.category = category;
+	entry.level = level;
+	entry.length = std::min(message.size(), (size_t) TRACE_MESSAGE_SIZE);
+	memcpy(entry.message, message.data(), entry.length);
+
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void trace_drain(trace_records& records) {
+	std::lock_guard<std::mutex> guard(trace_mutex);
+
+	for(auto it = trace_rings.begin(); it != trace_rings.end();) {
+		TraceRing *ring = *it;
+
+		size_t tail = ring->tail.load(std::memory_order_relaxed);
+		size_t head = ring->head.load(std::memory_order_acquire);
+
+		for(; tail != head; ++tail) {
+			const TraceEntry& entry = ring->entries[tail & (TRACE_RING_SIZE - 1)];
+
+			TraceRecord record;
+			record.time = entry.time;
+			record.category = (TraceCategory) entry.category;
+			record.level = (TraceLevel) entry.level;
+			record.message.assign(entry.message, entry.length);
+
+			records.push_back(record);
+		}
+
+		ring->tail.store(tail, std::memory_order_release);
+
+		// the thread is gone and everything was read
+
+		if(!ring->alive && tail == ring->head.load(std::memory_order_acquire)) {
+			delete ring;
+			it = trace_rings.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+uint64_t trace_dropped() {
+	return trace_lost.load(std::memory_order_relaxed);
+}
+
+void trace_set_level(TraceCategory category, TraceLevel level) {
+	trace_levels[category].store(level, std::memory_order_relaxed);
+}
+
+const char* trace_category_name(TraceCategory category) {
+	return category < TRACE_CATEGORIES ? trace_names[category] : "unknown";
+}
+
+bool trace_category_by_name(const std::string& name, TraceCategory& category) {
+	for(int i = 0; i < TRACE_CATEGORIES; ++i) {
+		if(name == trace_names[i]) {
+			category = (TraceCategory) i;
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,55 @@
+#ifndef TRACE_H
+#define TRACE_H 
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdint.h>
+
+enum TraceCategory {
+	TRACE_AGENT,
+	TRACE_STREAM,
+	TRACE_RECV,
+	TRACE_SEND,
+	TRACE_STATE,
+	TRACE_CATEGORIES,
+};
+
+enum TraceLevel {
+	TRACE_OFF = 0,
+	TRACE_ERROR = 1,
+	TRACE_INFO = 2,
+	TRACE_DEBUG = 3,
+};
+
+struct TraceRecord {
+	int64_t time;
+	TraceCategory category;
+	TraceLevel level;
+	std::string message;
+};
+
+typedef std::vector<TraceRecord> trace_records;
+
+extern std::atomic<int> trace_levels[TRACE_CATEGORIES];
+
+static inline bool trace_enabled(TraceCategory category, TraceLevel level) {
+	return trace_levels[category].load(std::memory_order_relaxed) >= level;
+}
+
+// writes into the ring buffer of the calling thread, drops the record if the buffer is full
+void trace_write(TraceCategory category, TraceLevel level, const std::string& message);
+
+// collects the records of all threads, call from one thread only
+void trace_drain(trace_records& records);
+
+// number of records dropped because a ring buffer was full
+uint64_t trace_dropped();
+
+void trace_set_level(TraceCategory category, TraceLevel level);
+
+const char* trace_category_name(TraceCategory category);
+bool trace_category_by_name(const std::string& name, TraceCategory& category);
+
+#endif /* TRACE_H */
@@ -0,0 +1,24 @@
+#include "work_queue.h"
+
+void WorkQueue::push(const work_fun& fun) {
+	std::lock_guard<std::mutex> guard(_mutex);
+
+	_queue.push_back(fun);
+}
+
+size_t WorkQueue::run() {
+	work_queue jobs;
+
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		jobs.swap(_queue);
+	}
+
+	// producers are not blocked while js is running
+
+	for(auto it = jobs.begin(); it != jobs.end(); ++it) {
+		(*it)();
+	}
+
+	return jobs.size();
+}
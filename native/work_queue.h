@@ -0,0 +1,25 @@
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H 
+
+#include <deque>
+#include <mutex>
+#include <functional>
+
+typedef std::function<void(void)> work_fun;
+typedef std::deque<work_fun> work_queue;
+
+// passes work from many producers to one consumer, the consumer has to be woken up by the caller
+
+class WorkQueue {
+	public:
+		void push(const work_fun& fun);
+
+		// runs everything queued so far without holding the lock, returns the number of jobs
+		size_t run();
+
+	private:
+		std::mutex _mutex;
+		work_queue _queue;
+};
+
+#endif /* WORK_QUEUE_H */
@@ -2,7 +2,7 @@
 
 var native_libnice = require("../build/Release/native_libnice");
 
-// turn the stream into an event emitter
+// turn the stream and the agent into event emitters
 
 function inject(target, source) {
     for (var k in source.prototype) {
@@ -11,8 +11,48 @@ function inject(target, source) {
 }
 
 inject(native_libnice.NiceStream, require('events').EventEmitter);
+inject(native_libnice.NiceAgent, require('events').EventEmitter);
+
+// tracing
+
+var trace_timer = null;
+
+function flushTrace() {
+    native_libnice.drainTrace().forEach(function(record) {
+        process.stderr.write("[libnice] " + record.time.toFixed(3) + " " + record.category + " " + record.message + "\n");
+    });
+}
+
+function traceToStderr(interval) {
+    if(trace_timer !== null) {
+        clearInterval(trace_timer);
+        trace_timer = null;
+    }
+
+    if(interval === 0) {
+        flushTrace();
+        return;
+    }
+
+    trace_timer = setInterval(flushTrace, interval || 100);
+    trace_timer.unref();
+}
+
+// NICE_TRACE=recv:debug,state:info or NICE_TRACE=all:debug
+
+if(process.env.NICE_TRACE) {
+    process.env.NICE_TRACE.split(",").forEach(function(setting) {
+        var parts = setting.split(":");
+        native_libnice.setTraceLevel(parts[0], parts[1] || "debug");
+    });
+
+    traceToStderr();
+}
 
 // export stuff
 
 exports.NiceAgent = native_libnice.NiceAgent;
-
+exports.setTraceLevel = native_libnice.setTraceLevel;
+exports.drainTrace = native_libnice.drainTrace;
+exports.traceDropped = native_libnice.traceDropped;
+exports.traceToStderr = traceToStderr;
@@ -0,0 +1,207 @@
+#!/usr/bin/env node
+
+// replays a capture written by stream.startCapture() through a local agent pair
+//
+// usage: replay.js capture.pcapng [scale]
+//
+// outbound packets are sent from the first agent, inbound packets from the
+// second one. scale speeds up (> 1) or slows down (< 1) the original timing,
+// a scale of 0 sends as fast as possible.
+
+var fs = require("fs");
+var NiceAgent = require("../src/module").NiceAgent;
+
+var SECTION_HEADER = 0x0A0D0D0A;
+var INTERFACE = 0x00000001;
+var ENHANCED_PACKET = 0x00000006;
+
+var OPT_END = 0;
+var OPT_EPB_FLAGS = 2;
+
+var INBOUND = 1;
+
+// parse capture
+
+function parseCapture(data) {
+    var interfaces = 0;
+    var packets = [];
+    var offset = 0;
+
+    if(data.readUInt32LE(0) !== SECTION_HEADER || data.readUInt32LE(8) !== 0x1A2B3C4D) {
+        throw new Error("Not a little endian pcapng file");
+    }
+
+    while(offset + 12 <= data.length) {
+        var type = data.readUInt32LE(offset);
+        var length = data.readUInt32LE(offset + 4);
+
+        if(length < 12) {
+            throw new Error("Invalid block at offset " + offset);
+        }
+
+        if(type === INTERFACE) {
+            interfaces++;
+        } else if(type === ENHANCED_PACKET) {
+            var captured = data.readUInt32LE(offset + 20);
+            var options = offset + 28 + ((captured + 3) & ~3);
+            var direction = 0;
+
+            while(options + 4 <= offset + length - 4) {
+                var code = data.readUInt16LE(options);
+                var size = data.readUInt16LE(options + 2);
+
+                if(code === OPT_END) {
+                    break;
+                }
+
+                if(code === OPT_EPB_FLAGS) {
+                    direction = data.readUInt32LE(options + 4) & 3;
+                }
+
+                options += 4 + ((size + 3) & ~3);
+            }
+
+            packets.push({
+                component: data.readUInt32LE(offset + 8) + 1,
+                time: data.readUInt32LE(offset + 12) * 4294967296 + data.readUInt32LE(offset + 16),
+                inbound: direction === INBOUND,
+                data: data.slice(offset + 28, offset + 28 + captured),
+            });
+        }
+
+        // everything else, like the filler of the ring, is skipped
+
+        offset += length;
+    }
+
+    // the ring might have wrapped around
+
+    packets.sort(function(a, b) {
+        return a.time - b.time;
+    });
+
+    return {
+        components: interfaces,
+        packets: packets,
+    };
+}
+
+// connect two agents
+
+function connect(components, callback) {
+    var agents = [new NiceAgent(), new NiceAgent()];
+    var streams = [];
+    var gathered = 0;
+    var ready = 0;
+
+    agents[0].setControlling(true);
+
+    agents.forEach(function(agent, index) {
+        var stream = agent.createStream(components);
+
+        stream.on('gatheringDone', function() {
+            if(++gathered < 2) {
+                return;
+            }
+
+            streams.forEach(function(stream, index) {
+                var other = streams[1 - index];
+                var credentials = other.getLocalCredentials();
+
+                stream.setRemoteCredentials(credentials.ufrag, credentials.pwd);
+
+                other.getLocalIceCandidates().forEach(function(candidate) {
+                    stream.addRemoteIceCandidate(candidate);
+                });
+            });
+        });
+
+        stream.on('stateChanged', function(component, state) {
+            if(state === "failed") {
+                throw new Error("Unable to connect component " + component);
+            }
+
+            if(state === "ready" && ++ready === 2 * components) {
+                callback(streams);
+            }
+        });
+
+        streams.push(stream);
+    });
+
+    streams.forEach(function(stream) {
+        stream.gatherCandidates();
+    });
+}
+
+// replay
+
+function replay(capture, scale, streams) {
+    var packets = capture.packets;
+    var received = [0, 0];
+    var sent = 0;
+    var start = Date.now();
+
+    streams.forEach(function(stream, index) {
+        stream.on('receive', function() {
+            received[index]++;
+        });
+    });
+
+    function finish() {
+        // give the last packets some time to arrive
+        setTimeout(function() {
+            var duration = (Date.now() - start) / 1000;
+
+            console.log("sent " + sent + " packets in " + duration + "s");
+            console.log("received " + received[1] + " outbound and " + received[0] + " inbound packets");
+
+            streams.forEach(function(stream) {
+                stream.close();
+            });
+
+            // the agents keep the event loop alive
+            process.exit(0);
+        }, 500);
+    }
+
+    function next(index) {
+        while(index < packets.length) {
+            var packet = packets[index];
+
+            if(scale > 0) {
+                var due = start + (packet.time - packets[0].time) / 1000 / scale;
+                var wait = due - Date.now();
+
+                if(wait > 0) {
+                    setTimeout(next, wait, index);
+                    return;
+                }
+            }
+
+            streams[packet.inbound ? 1 : 0].send(packet.component, packet.data);
+            sent++;
+            index++;
+        }
+
+        finish();
+    }
+
+    next(0);
+}
+
+var path = process.argv[2];
+var scale = process.argv[3] === undefined ? 1 : parseFloat(process.argv[3]);
+
+if(!path) {
+    console.error("usage: replay.js capture.pcapng [scale]");
+    process.exit(1);
+}
+
+var capture = parseCapture(fs.readFileSync(path));
+
+console.log("replaying " + capture.packets.length + " packets on " + capture.components + " components");
+
+connect(capture.components, function(streams) {
+    replay(capture, scale, streams);
+});